@@ -0,0 +1,25 @@
+# LZ4_INCLUDE_DIR
+# LZ4_LIBRARIES
+
+FIND_PATH(LZ4_INCLUDE_DIR NAMES lz4.h
+	PATHS 
+	/usr/include
+	${LZ4_ROOT}/include
+)
+FIND_LIBRARY(LZ4_LIBRARY NAMES liblz4.so liblz4.a lz4.lib
+	PATHS
+	/usr/lib/
+	/usr/lib/x86_64-linux-gnu/
+	${LZ4_ROOT}/lib
+)
+
+IF(LZ4_INCLUDE_DIR)
+IF(LZ4_LIBRARY)
+	SET(LZ4_LIBRARIES ${LZ4_LIBRARY})
+	SET(LZ4_FOUND "YES")
+ENDIF(LZ4_LIBRARY)
+ENDIF(LZ4_INCLUDE_DIR)
+
+MARK_AS_ADVANCED(
+	LZ4_LIBRARY LZ4_LIBRARIES
+)
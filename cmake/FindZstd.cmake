@@ -0,0 +1,25 @@
+# ZSTD_INCLUDE_DIR
+# ZSTD_LIBRARIES
+
+FIND_PATH(ZSTD_INCLUDE_DIR NAMES zstd.h
+	PATHS 
+	/usr/include
+	${ZSTD_ROOT}/include
+)
+FIND_LIBRARY(ZSTD_LIBRARY NAMES libzstd.so libzstd.a zstd.lib
+	PATHS
+	/usr/lib/
+	/usr/lib/x86_64-linux-gnu/
+	${ZSTD_ROOT}/lib
+)
+
+IF(ZSTD_INCLUDE_DIR)
+IF(ZSTD_LIBRARY)
+	SET(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+	SET(ZSTD_FOUND "YES")
+ENDIF(ZSTD_LIBRARY)
+ENDIF(ZSTD_INCLUDE_DIR)
+
+MARK_AS_ADVANCED(
+	ZSTD_LIBRARY ZSTD_LIBRARIES
+)
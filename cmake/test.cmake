@@ -15,6 +15,8 @@ INCLUDE(cmake/test_integrators.cmake)
 
 INCLUDE(cmake/test_monitors.cmake)
 
+INCLUDE(cmake/test_programs.cmake)
+
 # TEST_SCENARIO makes it easy to create scenarios and add it to the system
 # The first argument in the name of the folder and the second argument is the name of the 
 # config file (without extension). Just put in.txt and out.txt in that folder alongside with
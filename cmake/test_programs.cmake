@@ -0,0 +1,18 @@
+# Test programs built against the swarm library. Each one is in
+# ${TESTDIR}/<folder>/<name>.cpp and exits with a nonzero status when one of
+# its checks fails. Extra arguments are additional source files.
+# The programs get a prefix in the build directory for any files they write.
+
+MACRO(TEST_PROGRAM folder name)
+	SWARM_ADD_EXECUTABLE(test_${folder}_${name} ${TESTDIR}/${folder}/${name}.cpp ${ARGN})
+	ADD_TEST(NAME ${folder}_${name}
+		COMMAND test_${folder}_${name} ${CMAKE_CURRENT_BINARY_DIR}/test_${folder}_${name})
+ENDMACRO(TEST_PROGRAM)
+
+TEST_PROGRAM(kepler keplerian_batch)
+TEST_PROGRAM(query format)
+TEST_PROGRAM(log roundtrip)
+TEST_PROGRAM(log segments)
+TEST_PROGRAM(log index)
+TEST_PROGRAM(log queries ${CMAKE_SOURCE_DIR}/src/swarm/query.cpp)
+TEST_PROGRAM(log sort)
@@ -108,14 +108,19 @@ struct combine {
 
 
 	GPUAPI bool pass_one (int thread_in_system) 
-          {  return _monitor1.pass_one(thread_in_system) || _monitor2.pass_one(thread_in_system);  }
+          {
+	    // both monitors have to run, pass_one resets their state
+	    bool n1 = _monitor1.pass_one(thread_in_system);
+	    bool n2 = _monitor2.pass_one(thread_in_system);
+	    return n1 || n2;
+	  }
 	    
 
 	GPUAPI int pass_two (int thread_in_system) 
           {  
 	    int s1 = _monitor1.pass_two(thread_in_system);
 	    int s2 = _monitor2.pass_two(thread_in_system); 
-	    if((s1==0)&&(s1==0)) return 0;
+	    if((s1==0)&&(s2==0)) return 0;
 	    else if((s1<0)||(s2<0)) return (s1<s2) ? s1 : s2;
 	    else return (s1>s2) ? s1 : s2;
 	  }
@@ -0,0 +1,184 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file log_on_element_change.hpp
+ *   \brief Defines and implements the monitor \ref swarm::monitors::log_on_element_change
+ *          that logs systems when their orbits change.
+ *
+ */
+
+#pragma once
+
+#include "swarm/kepler.h"
+
+namespace swarm {
+  namespace monitors {
+
+/*! Parameters for log_on_element_change monitor
+ * log_delta_a (real): relative change of semi-major axis that triggers a snapshot
+ * log_delta_e (real): change of eccentricity that triggers a snapshot
+ * log_delta_i (real): change of inclination (degrees) that triggers a snapshot
+ * log_max_interval (real): longest time between two snapshots of a system
+ * log_check_interval (real): time between two checks of the orbital elements
+ *
+ * A threshold of 0 disables the corresponding test.
+ * \ingroup monitors_param
+ */ 
+struct log_on_element_change_params {
+	double delta_a, delta_e, delta_i;
+	double max_interval, check_interval;
+
+	log_on_element_change_params(const config &cfg)
+	{
+		delta_a = cfg.optional("log_delta_a", 0.0);
+		delta_e = cfg.optional("log_delta_e", 0.0);
+		delta_i = cfg.optional("log_delta_i", 0.0)*M_PI/180.;
+		max_interval = cfg.optional("log_max_interval", 0.0);
+		check_interval = cfg.optional("log_check_interval", 0.0);
+	}
+};
+
+/** Monitor that logs the state of a system when the osculating elements
+ *  of one of its planets drifted away from the last snapshot, or when 
+ *  log_max_interval has passed since the last snapshot.
+ *
+ *  The elements are astrocentric (relative to body 0) and are compared
+ *  to the elements at the time of the last snapshot logged by this monitor.
+ *  A snapshot is also written when the monitor starts, that is at the
+ *  beginning of every integration kernel, so the reference elements always
+ *  match a snapshot in the log. In stable systems most of the output
+ *  of log_time_interval is skipped.
+ *
+ *  Can be combined with other monitors using combine<>.
+ * 
+ *  \ingroup monitors
+ */
+template<class log_t>
+class log_on_element_change {
+	public:
+	typedef log_on_element_change_params params;
+
+	private:
+	params _params;
+        bool condition_met;
+	bool need_check, have_reference;
+
+	ensemble::SystemRef& _sys;
+	double _next_check_time, _last_log_time;
+	//! elements of the planets at the last snapshot
+	double _a[MAX_NBODIES], _e[MAX_NBODIES], _i[MAX_NBODIES];
+	log_t& _log;
+
+	public:
+		template<class T>
+		static GENERIC int thread_per_system(T compile_time_param){
+			return 1;
+		}
+
+		template<class T>
+		static GENERIC int shmem_per_system(T compile_time_param) {
+			 return 0;
+		}
+        GPUAPI bool is_deactivate_on() { return false; };
+        GPUAPI bool is_log_on() { return _params.delta_a > 0. || _params.delta_e > 0. || _params.delta_i > 0. || _params.max_interval > 0.; };
+        GPUAPI bool is_verbose_on() { return false; };
+        GPUAPI bool is_any_on() { return is_deactivate_on() || is_log_on() || is_verbose_on() ; }
+        GPUAPI bool is_condition_met () { return ( condition_met ); }
+        GPUAPI bool need_to_log_system () 
+          { return (is_log_on() && is_condition_met() ); }
+        GPUAPI bool need_to_deactivate () 
+          { return ( is_deactivate_on() && is_condition_met() ); }
+
+        GPUAPI void log_system()  {  log::system(_log, _sys);  }
+	
+        GPUAPI void operator () (const int thread_in_system) 
+          { 
+	    pass_one(thread_in_system);
+	    pass_two(thread_in_system);
+	    if(need_to_log_system() && (thread_in_system==0) )
+	      log_system();
+	  }
+
+	//! Astrocentric elements of body b
+	GPUAPI void calc_elements(const int b, double& a, double& e, double& i)
+	  {
+	    double x,y,z,vx,vy,vz, x0,y0,z0,vx0,vy0,vz0;
+	    _sys[b].get(x,y,z,vx,vy,vz);
+	    _sys[0].get(x0,y0,z0,vx0,vy0,vz0);
+	    double O, w, M;
+	    calc_keplerian_for_cartesian(a,e,i,O,w,M, x-x0,y-y0,z-z0, vx-vx0,vy-vy0,vz-vz0, _sys[0].mass()+_sys[b].mass());
+	  }
+
+	//! Test if the elements of any planet drifted beyond the thresholds,
+	//! the elements are stored as the new reference if they did
+	GPUAPI bool test_elements()
+	  {
+	    double a[MAX_NBODIES], e[MAX_NBODIES], i[MAX_NBODIES];
+	    bool changed = !have_reference;
+	    for(int b = 1; b < _sys.nbod(); b++)
+	      {
+		calc_elements(b, a[b], e[b], i[b]);
+		changed = changed
+		  || (_params.delta_a > 0. && fabs(a[b] - _a[b]) > _params.delta_a*fabs(_a[b]))
+		  || (_params.delta_e > 0. && fabs(e[b] - _e[b]) > _params.delta_e)
+		  || (_params.delta_i > 0. && fabs(i[b] - _i[b]) > _params.delta_i);
+	      }
+	    if(!changed) { return false; }
+
+	    for(int b = 1; b < _sys.nbod(); b++)
+	      { _a[b] = a[b]; _e[b] = e[b]; _i[b] = i[b]; }
+	    have_reference = true;
+	    return true;
+	  }
+
+	GPUAPI bool pass_one (int thread_in_system) 
+          {
+	    condition_met = false;
+	    need_check = is_log_on() && _sys.time() >= _next_check_time;
+	    return need_check;
+	  }
+	    
+
+	GPUAPI int pass_two (int thread_in_system) 
+          {
+	    if(need_check && (thread_in_system==0))
+	      {
+		_next_check_time = _sys.time() + _params.check_interval;
+		// the elements of an overdue snapshot are the new reference
+		if(_params.max_interval > 0. && _sys.time() >= _last_log_time + _params.max_interval)
+		  { have_reference = false; }
+		if(test_elements())
+		  {
+		    condition_met = true;
+		    _last_log_time = _sys.time();
+		  }
+	      }
+	    return _sys.state();
+	  }
+
+
+	GPUAPI log_on_element_change(const params& p,ensemble::SystemRef& s,log_t& l)
+		:_params(p),_sys(s),_log(l),condition_met(false),need_check(false),have_reference(false)
+		,_next_check_time(s.time()),_last_log_time(s.time()){}
+	
+};
+
+}
+
+
+}
@@ -37,6 +37,9 @@ if(BDB_FOUND)
 endif()
 
 ADD_PLUGIN(swarm/log/binary_writer.cpp Binary_Writer TRUE "Binary file writer")
+if(LZ4_FOUND OR ZSTD_FOUND)
+	ADD_PLUGIN(swarm/log/compressed_writer.cpp Compressed_Writer TRUE "Block-compressed binary file writer")
+endif()
 ADD_PLUGIN(swarm/log/host_array_writer.cpp Host_Array_Writer TRUE "Writer to the host arrays")
 
 
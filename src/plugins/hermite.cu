@@ -25,6 +25,7 @@
 #include "monitors/composites.hpp"
 #include "monitors/stop_on_ejection.hpp"
 #include "monitors/log_time_interval.hpp"
+#include "monitors/log_on_element_change.hpp"
 #include "swarm/gpu/gravitation_accjerk.hpp"
 #include "monitors/log_transit.hpp"
 #include "monitors/log_rvs.hpp"
@@ -47,6 +48,10 @@ integrator_plugin_initializer<hermite< stop_on_ejection_or_close_encounter<L>  ,
 integrator_plugin_initializer<hermite< log_time_interval<L>  , GravitationAccJerk > >
 	hermite_log_plugin("hermite_log");
 
+//! Initialize the hermite integrator plugin for stop_on_ejection combined with log_on_element_change
+integrator_plugin_initializer<hermite< combine< L, stop_on_ejection<L>, log_on_element_change<L> >  , GravitationAccJerk > >
+	hermite_log_change_plugin("hermite_log_change");
+
 //! Initialize the hermite integrator plugin for log_transition and gravitation acceleration
 integrator_plugin_initializer<hermite< log_transit<L>  , GravitationAccJerk > >
 	hermite_transit_plugin("hermite_transit");
@@ -23,6 +23,7 @@
 
 #include "integrators/hermite_cpu.hpp"
 #include "monitors/log_time_interval.hpp"
+#include "monitors/log_on_element_change.hpp"
 #include "monitors/stop_on_ejection.hpp"
 #include "monitors/composites.hpp"
 
@@ -55,4 +56,7 @@ integrator_plugin_initializer<
   hermite_cpu< log_time_interval<L> >
 	> hermite_cpu_log_plugin("hermite_cpu_log");
 
-
+//! Initialize the integrator plugin for hermite_cpu_log_change
+integrator_plugin_initializer<
+  hermite_cpu< combine< L, stop_on_ejection<L>, log_on_element_change<L> > >
+	> hermite_cpu_log_change_plugin("hermite_cpu_log_change");
@@ -0,0 +1,194 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file format.cpp
+ *    \brief Implements fast formatting of numbers for the text outputs.
+ *
+ *
+ */
+
+#include "common.hpp"
+#include "format.hpp"
+
+namespace swarm {
+
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 uint128;
+
+//! Powers of ten up to 10^38, the largest that fits in 128 bits
+struct pow10_table
+{
+	uint128 p[39];	//!< 10^k
+	int bits[39];	//!< number of bits of 10^k
+	pow10_table()
+	{
+		p[0] = 1; bits[0] = 1;
+		for(int k = 1; k != 39; k++)
+		{
+			p[k] = p[k-1] * 10;
+			bits[k] = 0;
+			for(uint128 x = p[k]; x; x >>= 1) { bits[k]++; }
+		}
+	}
+};
+static const pow10_table powers_of_ten;
+
+/*! The first P (<= 17) significant digits of v > 0, correctly rounded (half to even)
+ *
+ * v = m 2^q is scaled by 10^k (k = P - 1 - X, X the decimal exponent) to the
+ * fraction N / D of two 128 bit integers. Returns false if they would not fit.
+ */
+static bool decimal_digits(double v, int P, uint64_t &digits, int &X)
+{
+	int q;
+	uint64_t m = (uint64_t)ldexp(frexp(v, &q), 53);
+	q -= 53;
+
+	X = (int)floor(log10(v));
+	for(int attempt = 0; attempt != 3; attempt++)
+	{
+		int k = P - 1 - X;
+		if(k > 38 || k < -38) { return false; }
+		int nbits = 53 + (k > 0 ? powers_of_ten.bits[k] : 0) + (q > 0 ? q : 0);
+		int dbits = (k < 0 ? powers_of_ten.bits[-k] : 0) + (q < 0 ? -q : 0);
+		if(nbits > 126 || dbits > 126) { return false; }
+
+		uint128 N = m, D = 1;
+		if(k > 0) { N *= powers_of_ten.p[k]; } else { D *= powers_of_ten.p[-k]; }
+		if(q > 0) { N <<= q; } else { D <<= -q; }
+
+		uint128 d = N / D, r = N % D;
+		// log10 may be off by one near powers of ten
+		if(d >= powers_of_ten.p[P]) { X++; continue; }
+		if(d < powers_of_ten.p[P-1]) { X--; continue; }
+
+		if(2*r > D || (2*r == D && (d & 1))) { d++; }
+		if(d == powers_of_ten.p[P]) { d = powers_of_ten.p[P-1]; X++; }
+		digits = (uint64_t)d;
+		return true;
+	}
+	return false;
+}
+
+#else
+
+static bool decimal_digits(double v, int P, uint64_t &digits, int &X) { return false; }
+
+#endif
+
+//! Write the n digits of d to buf
+static void write_digits(char *buf, uint64_t d, int n)
+{
+	for(int i = n - 1; i >= 0; i--) { buf[i] = '0' + d % 10; d /= 10; }
+}
+
+//! Write the exponent of the %e and %g conversions (e+XX)
+static int write_exponent(char *buf, int X)
+{
+	char *p = buf;
+	*p++ = 'e';
+	*p++ = X < 0 ? '-' : '+';
+	if(X < 0) { X = -X; }
+	if(X >= 100) { *p++ = '0' + X / 100; }
+	*p++ = '0' + X / 10 % 10;
+	*p++ = '0' + X % 10;
+	return p - buf;
+}
+
+//! Right-justify the n characters of buf in a field of width characters
+static int pad(char *buf, int n, int width)
+{
+	if(n < width)
+	{
+		memmove(buf + width - n, buf, n);
+		memset(buf, ' ', width - n);
+		n = width;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+int format_e(char *buf, double v, int prec)
+{
+	uint64_t d = 0;
+	int X = 0;
+	if(!(std::isfinite(v) && prec <= 16 && (v == 0 || decimal_digits(fabs(v), prec + 1, d, X))))
+		return snprintf(buf, 64, "%.*e", prec, v);
+
+	char *p = buf;
+	if(std::signbit(v)) { *p++ = '-'; }
+	char digits[20];
+	write_digits(digits, d, prec + 1);
+	*p++ = digits[0];
+	if(prec > 0) { *p++ = '.'; memcpy(p, digits + 1, prec); p += prec; }
+	p += write_exponent(p, X);
+	*p = '\0';
+	return p - buf;
+}
+
+int format_g(char *buf, double v, int prec, int width, bool space)
+{
+	int P = prec == 0 ? 1 : prec;
+	uint64_t d = 0;
+	int X = 0;
+	if(!(std::isfinite(v) && P <= 17 && (v == 0 || decimal_digits(fabs(v), P, d, X))))
+		return snprintf(buf, 64 + width, space ? "% *.*g" : "%*.*g", width, prec, v);
+
+	char *p = buf;
+	if(std::signbit(v)) { *p++ = '-'; } else if(space) { *p++ = ' '; }
+
+	char digits[20];
+	write_digits(digits, d, P);
+	int n = P;
+	while(n > 1 && digits[n-1] == '0') { n--; }	// %g drops the trailing zeros
+
+	if(X < -4 || X >= P)
+	{
+		*p++ = digits[0];
+		if(n > 1) { *p++ = '.'; memcpy(p, digits + 1, n - 1); p += n - 1; }
+		p += write_exponent(p, X);
+	}
+	else if(X >= 0)
+	{
+		memcpy(p, digits, X + 1); p += X + 1;
+		if(n > X + 1) { *p++ = '.'; memcpy(p, digits + X + 1, n - X - 1); p += n - X - 1; }
+	}
+	else
+	{
+		*p++ = '0'; *p++ = '.';
+		for(int i = 0; i != -X - 1; i++) { *p++ = '0'; }
+		memcpy(p, digits, n); p += n;
+	}
+	return pad(buf, p - buf, width);
+}
+
+int format_d(char *buf, int v, int width)
+{
+	char digits[12];
+	unsigned int u = v < 0 ? 0u - (unsigned int)v : v;
+	int n = 0;
+	do { digits[n++] = '0' + u % 10; u /= 10; } while(u);
+
+	char *p = buf;
+	if(v < 0) { *p++ = '-'; }
+	while(n) { *p++ = digits[--n]; }
+	return pad(buf, p - buf, width);
+}
+
+}
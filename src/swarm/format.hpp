@@ -0,0 +1,51 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file format.hpp
+ *    \brief Defines fast formatting of numbers for the text outputs.
+ *
+ *
+ */
+
+#pragma once
+
+namespace swarm {
+
+/**
+ *   \brief Formatting of numbers, equivalent to printf but faster.
+ *
+ *   The functions write exactly what the printf conversion in their
+ *   description would, including the rounding of the last digit, terminate
+ *   it with '\0' and return the number of characters (like snprintf).
+ *   The digits are computed with integer arithmetic when the value can be
+ *   scaled exactly in 128 bits, which covers the values that occur in
+ *   practice; for others (and for infinities or NaN) they call snprintf.
+ *   buf must hold at least 32 characters, or width + 1 if that is more.
+ *
+ */
+
+//! Write v like printf("%.*e", prec, v), for prec <= 16
+int format_e(char *buf, double v, int prec);
+
+//! Write v like printf("%*.*g", width, prec, v) or, if space is set, printf("% *.*g", width, prec, v), for prec <= 17
+int format_g(char *buf, double v, int prec = 6, int width = 0, bool space = false);
+
+//! Write v like printf("%*d", width, v)
+int format_d(char *buf, int v, int width = 0);
+
+}
@@ -21,19 +21,24 @@
  *  \brief converts between Cartesian & Keplerian coordinates
  *
  *  Based on code from John Chambers' Mercury code 
+ *  The functions are GENERIC so that monitors can use them on the GPU.
  *  \todo put proper refernece to publication or URL.
  */
 
 #ifndef H_SWARM_KEPLER
+#define H_SWARM_KEPLER
 
-double improve_mean_to_eccentric_annomaly_guess(const double e, const double M, const double x);
-double mean_to_eccentric_annomaly(const double e,  double M);
-void calc_cartesian_for_ellipse(double& x,double& y, double & z, double &vx, double &vy, double &vz, const double a, const double e, const double i, const double O, const double w, const double M, const double GM);
-void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O,  double& w,  double& M, const double x,const double y, const double z, const double vx, const double vy, const double vz, const double GM);
+#include "types/coalescedstructarray.hpp"
+
+GENERIC double improve_mean_to_eccentric_annomaly_guess(const double e, const double M, const double x);
+GENERIC double mean_to_eccentric_annomaly(const double e,  double M);
+GENERIC void calc_cartesian_for_ellipse(double& x,double& y, double & z, double &vx, double &vy, double &vz, const double a, const double e, const double i, const double O, const double w, const double M, const double GM);
+GENERIC void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O,  double& w,  double& M, const double x,const double y, const double z, const double vx, const double vy, const double vz, const double GM);
+GENERIC void calc_keplerian_for_cartesian_batch( const int n, double a[], double e[], double i[], double O[], double w[], double M[], const double x[], const double y[], const double z[], const double vx[], const double vy[], const double vz[], const double GM[]);
 
 // Code in this file largely adapted from Mercury.  
 
-double improve_mean_to_eccentric_annomaly_guess(const double e, const double M, const double x)
+GENERIC double improve_mean_to_eccentric_annomaly_guess(const double e, const double M, const double x)
 {
   // Based on Mercury
   //  double sx, cx;
@@ -53,7 +58,7 @@ double improve_mean_to_eccentric_annomaly_guess(const double e, const double M,
 };
 
 /// calculate mean anomaly to eccentric anomaly
-double mean_to_eccentric_annomaly(const double e,  double M)
+GENERIC double mean_to_eccentric_annomaly(const double e,  double M)
 {
   // Based on Mercury
   const int ORBEL_EHIE_NMAX = 3;
@@ -81,7 +86,7 @@ double mean_to_eccentric_annomaly(const double e,  double M)
 }
 
 /// Calculate the caresian coordinates for the ellipse
-void calc_cartesian_for_ellipse(double& x,double& y, double & z, double &vx, double &vy, double &vz, const double a, const double e, const double i, const double O, const double w, const double M, const double GM)
+GENERIC void calc_cartesian_for_ellipse(double& x,double& y, double & z, double &vx, double &vy, double &vz, const double a, const double e, const double i, const double O, const double w, const double M, const double GM)
 {
   double cape = mean_to_eccentric_annomaly(e,M);
   double scap, ccap;
@@ -107,15 +112,27 @@ void calc_cartesian_for_ellipse(double& x,double& y, double & z, double &vx, dou
   vy = d1[1]*vfac1+d2[1]*vfac2;
   vz = d1[2]*vfac1+d2[2]*vfac2;
 }
-void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O,  double& w,  double& M, const double x,const double y, const double z, const double vx, const double vy, const double vz, const double GM)
+/*! Quantities of a relative state vector that calc_keplerian_for_cartesian starts from.
+ *  They take only arithmetic and square roots, so calc_keplerian_for_cartesian_batch
+ *  computes them for many bodies in loops the compiler can vectorize.
+ */
+GENERIC void calc_keplerian_invariants( double h[3], double& h2, double& hh, double& fac, double& r, double& energy, double& rv, const double x,const double y, const double z, const double vx, const double vy, const double vz, const double GM)
+{
+  h[0] = y*vz-z*vy; h[1] = z*vx-x*vz; h[2] = x*vy-y*vx;
+  h2 = h[0]*h[0]+h[1]*h[1]+h[2]*h[2];
+  hh = sqrt(h2);
+  fac = sqrt(h[0]*h[0]+h[1]*h[1])/hh;
+  r = sqrt(x*x+y*y+z*z);
+  energy = (vx*vx+vy*vy+vz*vz)*0.5-GM/r;
+  rv = vx*x+vy*y+vz*z;
+}
+
+//! Orbital elements for the quantities from calc_keplerian_invariants
+GENERIC void calc_keplerian_for_invariants( double& a,  double& e,  double& i,  double& O,  double& w,  double& M, const double x,const double y, const double z, const double h[3], const double h2, const double hh, double fac, const double r, const double energy, const double rv, const double GM)
 {
   const double TINY = 1.e-8;
 
-  double h[] = {y*vz-z*vy, z*vx-x*vz, x*vy-y*vx};
-  double h2 = h[0]*h[0]+h[1]*h[1]+h[2]*h[2];
-  double hh = sqrt(h2);
   i = acos(h[2]/hh);
-  double fac = sqrt(h[0]*h[0]+h[1]*h[1])/hh;
   double u;
   if(fac<TINY)
     {
@@ -126,20 +143,20 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
   else
     {
       O = atan2(h[0],-h[1]);
-      u = atan2(z/sin(i),x*cos(O)+y*sin(O));
+      double sO, cO;
+      sincos(O,&sO,&cO);
+      u = atan2(z/sin(i),x*cO+y*sO);
     }
   if(O<0.) O += 2.*M_PI;
   if(u<0.) u += 2.*M_PI;
-  double r = sqrt(x*x+y*y+z*z);
-  double energy = (vx*vx+vy*vy+vz*vz)*0.5-GM/r;
   
   if(fabs(energy*r/GM)<sqrt(TINY))
     { // Parabola
       a = 0.5*h2/GM;
       e = 1.;
       double ww = acos(2.*a/r-1.);
-      if(vx*x+vy*y+vz*z<0.) w = 2.*M_PI-w;
-      double tmpf = tan(0.5*w);
+      if(rv<0.) ww = 2.*M_PI-ww;
+      double tmpf = tan(0.5*ww);
       M = tmpf*(1.+tmpf*tmpf/3.);
       w = u-ww;
       if(w<0.) w+= 2.*M_PI;
@@ -149,7 +166,7 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
     { // Elipse
       a = -0.5*GM/energy;
       fac = 1.-h2/(GM*a);
-      double ww, cape;
+      double ww, cape, scape;
       if(fac>TINY)
 	{
 	  e = sqrt(fac);
@@ -158,9 +175,11 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
 	  else if (face>-1.) cape = acos(face);
 	  else cape = M_PI;
 	  
-	  if(vx*x+vy*y+vz*z<0.) cape = 2.*M_PI-cape;
-	  double cw = (cos(cape)-e)/(1.-e*cos(cape));
-	  double sw = sqrt(1.-e*e)*sin(cape)/(1.-e*cos(cape));
+	  if(rv<0.) cape = 2.*M_PI-cape;
+	  double ccape = cos(cape);
+	  scape = sin(cape);
+	  double cw = (ccape-e)/(1.-e*ccape);
+	  double sw = sqrt(1.-e*e)*scape/(1.-e*ccape);
 	  ww = atan2(sw,cw);
 	  if(ww<0.) ww += 2.*M_PI;
 	}
@@ -169,8 +188,9 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
 	  e = 0.;
 	  ww = u;
 	  cape = u;
+	  scape = sin(cape);
 	}
-      M = cape - e*sin(cape);
+      M = cape - e*scape;
       w = u - ww;
       if(w<0.) w += 2.*M_PI;
       w -= round(w/(2.*M_PI))*2.*M_PI;
@@ -185,9 +205,10 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
 	  e = sqrt(1.+fac);
 	  double tmpf = (a+r)/(a*e);
 	  capf = log(tmpf+sqrt(tmpf*tmpf-1.));
-	  if(vx*x+vy*y+vz*z<0.) capf = -capf;
-	  double cw = (e-cosh(capf))/(e*cosh(capf)-1.);
-	  double sw = sqrt(e*e-1.)*sinh(capf)/(e*cosh(capf)-1.);
+	  if(rv<0.) capf = -capf;
+	  double chf = cosh(capf), shf = sinh(capf);
+	  double cw = (e-chf)/(e*chf-1.);
+	  double sw = sqrt(e*e-1.)*shf/(e*chf-1.);
 	  ww = atan2(sw,cw);
 	  if(ww<0.) ww += 2.*M_PI;	  
 	}
@@ -196,7 +217,7 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
 	  e = 1.;
 	  double tmpf = 0.5*h2/GM;
 	  ww = acos(2.*tmpf/r-1.);
-	  if(vx*x+vy*y+vz*z<0.) ww = 2.*M_PI-ww;
+	  if(rv<0.) ww = 2.*M_PI-ww;
 	  tmpf = (a+r)/(a*e);
 	  capf = log(tmpf+sqrt(tmpf*tmpf-1.));
 	}
@@ -207,5 +228,33 @@ void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O
     }
 };
 
+GENERIC void calc_keplerian_for_cartesian( double& a,  double& e,  double& i,  double& O,  double& w,  double& M, const double x,const double y, const double z, const double vx, const double vy, const double vz, const double GM)
+{
+  double h[3], h2, hh, fac, r, energy, rv;
+  calc_keplerian_invariants(h, h2, hh, fac, r, energy, rv, x, y, z, vx, vy, vz, GM);
+  calc_keplerian_for_invariants(a, e, i, O, w, M, x, y, z, h, h2, hh, fac, r, energy, rv, GM);
+};
+
+/*! Orbital elements for n relative state vectors (arrays of n values each)
+ *
+ *  The results are the same as calling calc_keplerian_for_cartesian for each
+ *  of them. The invariants are computed for chunks of the vectors at a time
+ *  in loops over arrays that the compiler can vectorize, the transcendental
+ *  part of the conversion is done for one vector at a time.
+ */
+GENERIC void calc_keplerian_for_cartesian_batch( const int n, double a[], double e[], double i[], double O[], double w[], double M[], const double x[], const double y[], const double z[], const double vx[], const double vy[], const double vz[], const double GM[])
+{
+  const int CHUNK = 32;
+  double h[CHUNK][3], h2[CHUNK], hh[CHUNK], fac[CHUNK], r[CHUNK], energy[CHUNK], rv[CHUNK];
+  for(int s = 0; s < n; s += CHUNK)
+    {
+      const int m = n - s < CHUNK ? n - s : CHUNK;
+      for(int k = 0; k < m; k++)
+	calc_keplerian_invariants(h[k], h2[k], hh[k], fac[k], r[k], energy[k], rv[k], x[s+k], y[s+k], z[s+k], vx[s+k], vy[s+k], vz[s+k], GM[s+k]);
+      for(int k = 0; k < m; k++)
+	calc_keplerian_for_invariants(a[s+k], e[s+k], i[s+k], O[s+k], w[s+k], M[s+k], x[s+k], y[s+k], z[s+k], h[k], h2[k], hh[k], fac[k], r[k], energy[k], rv[k], GM[s+k]);
+    }
+}
+
 
 #endif
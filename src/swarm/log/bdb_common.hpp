@@ -0,0 +1,235 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file bdb_common.hpp
+ *    \brief Defines bulk loading and secondary indexes of log databases in Berkeley DB.
+ *
+ *  Shared by the bdb writer plugin and the log2db utility. 
+ */
+
+#pragma once
+
+#include "../common.hpp"
+#include "gpulog/gpulog.h"
+
+#include <memory>
+#include <db_cxx.h>
+
+namespace swarm { namespace log { namespace bdb {
+
+/**
+ *  \brief Writes log records to a primary database in batches.
+ *
+ *  Records are collected in a bulk buffer and written with a single
+ *  DB_MULTIPLE_KEY put when the buffer is full (or flush() is called).
+ *  If the database is opened in a transactional environment, every
+ *  batch is written in its own transaction. The key of a record is
+ *  its record number: a db_recno_t for recno databases and
+ *  the raw bytes of the number for btree databases.
+ */
+class bulk_loader
+{
+	Db &db;
+	DbEnv *env;
+	//! 4-byte aligned bulk buffer as required by the bulk builders
+	std::vector<uint32_t> buffer;
+	Dbt bulk;
+	//! The builders keep the write position, so they live as long as the batch
+	std::auto_ptr<DbMultipleRecnoDataBuilder> recno_builder;
+	std::auto_ptr<DbMultipleKeyDataBuilder> key_builder;
+	bool recno;
+	size_t nrecords;
+
+	void reset()
+	{
+		bulk.set_data(&buffer[0]);
+		bulk.set_ulen(buffer.size()*sizeof(uint32_t));
+		bulk.set_flags(DB_DBT_USERMEM | DB_DBT_BULK);
+		if(recno)
+			recno_builder.reset(new DbMultipleRecnoDataBuilder(bulk));
+		else
+			key_builder.reset(new DbMultipleKeyDataBuilder(bulk));
+		nrecords = 0;
+	}
+
+	bool append(db_recno_t key, const void *data, size_t len)
+	{
+		if(recno)
+			return recno_builder->append(key, (void *)data, len);
+		else
+			return key_builder->append(&key, sizeof(key), (void *)data, len);
+	}
+
+public:
+	//! env is the transactional environment of db, NULL to write without transactions
+	bulk_loader(Db &db_, size_t batch_bytes, DbEnv *env_ = NULL)
+		: db(db_), env(env_), buffer(std::max<size_t>(batch_bytes, 64*1024)/sizeof(uint32_t))
+	{
+		DBTYPE type;
+		db.get_type(&type);
+		recno = type == DB_RECNO || type == DB_QUEUE;
+		reset();
+	}
+
+	~bulk_loader() { flush(); }
+
+	//! Add a record, the batch is written out if it is full
+	void put(db_recno_t key, const void *data, size_t len)
+	{
+		if(append(key, data, len)) { nrecords++; return; }
+
+		flush();
+		if(!append(key, data, len))
+		{
+			// larger than a whole batch, write it on its own
+			Dbt k(&key, sizeof(key)), d((void *)data, len);
+			db.put(NULL, &k, &d, env != NULL ? DB_AUTO_COMMIT : 0);
+			return;
+		}
+		nrecords++;
+	}
+
+	//! Write out the current batch
+	void flush()
+	{
+		if(nrecords == 0) { return; }
+
+		DbTxn *txn = NULL;
+		if(env != NULL) { env->txn_begin(NULL, &txn, 0); }
+		db.put(txn, &bulk, NULL, DB_MULTIPLE_KEY);
+		if(txn != NULL) { txn->commit(0); }
+
+		reset();
+	}
+};
+
+//! Store a copy of t as the secondary key
+template<typename T>
+void put_in_dbt(const T& t, Dbt* data){
+	data->set_flags(DB_DBT_APPMALLOC);
+	data->set_size(sizeof(T));
+	data->set_data(malloc(sizeof(T)));
+	memcpy(data->get_data(), &t, sizeof(T));
+}
+
+//! Extract the time and system of a log record, false for records without them
+inline bool extract_from_ptr(void* ptr, size_t size, double& time, int& sys){
+	gpulog::logrecord l((char*)ptr);
+	assert(l.len() == size);
+
+	// Based on the implementation in query.cpp
+	switch(l.msgid()){
+	case 1: case 2: case 11: case 15: case 16:
+		l >> time >> sys;
+		return true;
+
+	default:
+		return false;
+	}
+
+}
+
+/**
+ * Extract the system ID from a log record
+ *
+ * @param secondary: The secondary parameter is the database handle for the secondary.
+ * @param key      : The key parameter is a Dbt referencing the primary key.
+ * @param data     : The data parameter is a Dbt referencing the primary data item.
+ * @param result   : The result parameter is a zeroed Dbt in which the callback function
+ *                   should fill in data and size fields that describe the secondary key or keys.
+ */
+inline int lr_extract_sysid(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
+	double time = -1; int sys = -1;
+
+	if(extract_from_ptr(data->get_data(), data->get_size(), time, sys)){
+		put_in_dbt(sys, result);
+		return 0;
+	} else
+		return DB_DONOTINDEX;
+}
+
+//! Extract the event ID from a log record
+inline int lr_extract_evtid(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
+	gpulog::logrecord l((char*)data->get_data());
+	assert(l.len() == data->get_size());
+
+	put_in_dbt(l.msgid(), result);
+
+	return 0;
+}
+
+//! Extract the time from a log record
+inline int lr_extract_time(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
+	double time = -1; int sys = -1;
+
+	if(extract_from_ptr(data->get_data(), data->get_size(), time, sys)){
+		put_in_dbt(time, result);
+		return 0;
+	} else
+		return DB_DONOTINDEX;
+}
+
+//! Order time keys numerically
+inline int compare_time(DB* db, const DBT *k1, const DBT* k2){
+    if(k1->size < k2->size)
+        return -1;
+    else if(k1->size > k2->size)
+        return 1;
+    else{
+        if( (k1->size == 8) && (k2->size == 8) ) {
+            double a, b;
+            memcpy(&a, k1->data, sizeof(a));
+            memcpy(&b, k2->data, sizeof(b));
+            if(a < b) return -1;
+            else if(a > b) return 1;
+            else return 0;
+        }else{
+            return 0;
+        }
+    }
+}
+
+/*!
+ * Build the system, time and event secondary indexes (base.sys.db,
+ * base.time.db and base.evt.db) of a primary database that has been
+ * loaded. Associating with DB_CREATE builds each index in one pass over
+ * the primary, which is much faster than maintaining them on every put.
+ */
+inline void build_secondary_indexes(Db &primary, const std::string &base, DbEnv *env = NULL)
+{
+	Db system_idx(env, 0), time_idx(env, 0), event_idx(env, 0);
+	u_int32_t flags = DB_CREATE | (env != NULL ? DB_AUTO_COMMIT : 0);
+
+	system_idx.set_flags(DB_DUP | DB_DUPSORT);
+	system_idx.open(NULL, (base+".sys.db").c_str(), NULL, DB_BTREE, flags, 0);
+	time_idx.set_flags(DB_DUP | DB_DUPSORT);
+	time_idx.set_bt_compare(compare_time);
+	time_idx.open(NULL, (base+".time.db").c_str(), NULL, DB_BTREE, flags, 0);
+	event_idx.set_flags(DB_DUP | DB_DUPSORT);
+	event_idx.open(NULL, (base+".evt.db").c_str(), NULL, DB_BTREE, flags, 0);
+
+	primary.associate(NULL, &system_idx,  &lr_extract_sysid, DB_IMMUTABLE_KEY | DB_CREATE);
+	primary.associate(NULL, &time_idx  ,  &lr_extract_time , DB_IMMUTABLE_KEY | DB_CREATE);
+	primary.associate(NULL, &event_idx ,  &lr_extract_evtid, DB_IMMUTABLE_KEY | DB_CREATE);
+
+	system_idx.close(0);
+	time_idx.close(0);
+	event_idx.close(0);
+}
+
+} } }
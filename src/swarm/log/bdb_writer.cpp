@@ -30,7 +30,8 @@
 #include "log.hpp"
 #include "writer.h"
 
-#include <db_cxx.h>
+#include "bdb_common.hpp"
+#include <cerrno>
 
 namespace swarm { namespace log {
 
@@ -47,7 +48,11 @@ using namespace gpulog;
  *  Replace <fileName> with the name of the output file without extension. the db extension will be added
  *  automatically.
  *
- *
+ *  Records are written in batches of log_bdb_batch_size bytes using the
+ *  bulk put interface. If log_bdb_transactions is set, the database is opened
+ *  in a transactional environment in log_bdb_home and every batch is
+ *  committed as one transaction. If log_bdb_indexes is set, the system, time
+ *  and event indexes are built in one pass when the writer is closed.
  *
  *  *EXPERIMENTAL*: This class is not thoroughly tested.
  *  \ingroup experimental
@@ -56,34 +61,58 @@ using namespace gpulog;
  */
 class bdb_writer : public writer
 {
-	// To do this, first we have to include the BDB in the CMake files
-	// in process, we should make a gpulog::ilogstream out of the data
-	// and read all the gpulog records and put them in the database
-	// now the problem is what are we going to use for the key. Maybe we
-	// can use a very simple key and later on we can do secondary databases
-	// to make the indexes based on time and system id.
+	std::auto_ptr<DbEnv> env;
+	std::auto_ptr<Db> db;
+	std::auto_ptr<bdb::bulk_loader> loader;
+	std::string baseName;
+	bool build_indexes;
+	db_recno_t recno;
 
-	Db db;
 //! constructor for bdb_writer
 public:
-	bdb_writer(const config& cfg):db(0,0){
-		std::string fileName = cfg.require("log_output_db",std::string()) + ".db";
-		db.open(NULL, fileName.c_str() , NULL, DB_RECNO, DB_CREATE | DB_TRUNCATE, 0);
+	bdb_writer(const config& cfg):recno(0){
+		baseName = cfg.require("log_output_db",std::string());
+		std::string fileName = baseName + ".db";
+		size_t batch_size = cfg.optional("log_bdb_batch_size", 4*1024*1024);
+		build_indexes = cfg.optional("log_bdb_indexes", 0) != 0;
+
+		u_int32_t flags = DB_CREATE | DB_TRUNCATE;
+		if(cfg.optional("log_bdb_transactions", 0) != 0) {
+			env.reset(new DbEnv(0));
+			// Batches are durable in the log, the log is flushed lazily
+			env->set_flags(DB_TXN_WRITE_NOSYNC, 1);
+			env->open(cfg.optional("log_bdb_home", std::string(".")).c_str(),
+					DB_CREATE | DB_INIT_MPOOL | DB_INIT_TXN | DB_INIT_LOCK | DB_INIT_LOG, 0);
+			// DB_TRUNCATE cannot be transaction-protected, the old database
+			// is removed through the environment, which resolves its path
+			try {
+				env->dbremove(NULL, fileName.c_str(), NULL, DB_AUTO_COMMIT);
+			} catch(const DbException &e) {
+				if(e.get_errno() != ENOENT) throw;
+			}
+			flags = DB_CREATE | DB_AUTO_COMMIT;
+		}
+
+		db.reset(new Db(env.get(), 0));
+		db->open(NULL, fileName.c_str() , NULL, DB_RECNO, flags, 0);
+		loader.reset(new bdb::bulk_loader(*db, batch_size, env.get()));
 	}
 
         //! Process the log data and put them in the database
 	virtual void process(const char *log_data, size_t length) {
 		ilogstream stream(log_data,length);
 		while(logrecord lr = stream.next()){
-			Dbt key(NULL,0);
-			Dbt data((void*)lr.ptr,lr.len());
-			db.put(NULL,&key,&data,DB_APPEND);
+			loader->put(++recno, lr.ptr, lr.len());
 		}
 	}
 
         //! Destructor
 	~bdb_writer(){
-		db.close(0);
+		loader.reset();
+		if(build_indexes)
+			bdb::build_secondary_indexes(*db, baseName, env.get());
+		db->close(0);
+		if(env.get() != NULL) env->close(0);
 	}
 };
 
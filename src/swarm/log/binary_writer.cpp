@@ -29,12 +29,25 @@
 
 #include "io.hpp"
 #include "writer.h"
+#include "snapshot_codec.hpp"
+#include "segments.hpp"
 
 namespace swarm { namespace log {
 
 /**
  *   \brief A writer plugin that writes to binary files. (default writer in swarm)
  *
+ *   If log_block_size is set, the records are grouped in blocks of
+ *   (at least) that many bytes, each with a swarm_block_header that
+ *   summarizes the records in it. Otherwise the records are written
+ *   back to back.
+ *
+ *   If log_snapshot_encoding is "delta", snapshots are stored as
+ *   compact records (see snapshot_encoder).
+ *
+ *   If log_segment_size or log_segment_time is set, the output is
+ *   split into segments (see log_segments).
+ *
  */
 class binary_writer : public writer
 {
@@ -42,22 +55,30 @@ protected:
 	std::auto_ptr<std::ostream> output;
 	std::string rawfn, binfn;
 
+	//! Size of the blocks in bytes, 0 if not block-framed
+	size_t block_size;
+	//! Records of the block that is currently being filled
+	std::vector<char> block;
+	swarm_block_header block_hdr;
+	//! Encoder of compact snapshots, NULL if snapshots are stored in full
+	std::auto_ptr<snapshot_encoder> encoder;
+	log_segments segments;
+
 //! Constructor
 public:
-	binary_writer(const config &cfg)
+	binary_writer(const config &cfg) : segments(cfg)
 	{
 		binfn = cfg.at("log_output");
 		if(binfn=="")
 			ERROR("Expected filename for writer.")
 				rawfn = binfn + ".raw";
 
-		output.reset(new std::ofstream(rawfn.c_str()));
-		if(!*output)
-			ERROR("Could not open '" + rawfn + "' for writing");
+		block_size = cfg.optional("log_block_size", 0);
+		if(block_size != 0 && block_size < 16*sizeof(swarm_block_header))
+			ERROR("log_block_size is too small.");
+		encoder.reset(snapshot_encoder::create(cfg));
 
-		// write header
-		swarm::swarm_header fh(query::UNSORTED_HEADER_FULL);
-		output->write((char*)&fh, sizeof(fh));
+		open_output(segments.enabled() ? segments.next() : rawfn);
 	}
 
 	/*
@@ -68,14 +89,97 @@ public:
 	 */
 	~binary_writer()
 	{
+		write_block();
 		output.reset(NULL);
 	}
 
         //! Process the log data and write to output
 	virtual void process(const char *log_data, size_t length)
 	{
-		// TODO: filter out the printfs
-		output->write(log_data, length);
+		if(segments.full()) { rotate(); }
+
+		if(block_size == 0 && encoder.get() == NULL && !segments.by_time())
+		{
+			output->write(log_data, length);
+			segments.add(length);
+			return;
+		}
+
+		gpulog::ilogstream ils(log_data, length);
+		gpulog::logrecord lr;
+		while(lr = ils.next())
+		{
+			if(encoder.get() != NULL) { lr = encoder->encode(lr); }
+			if(segments.by_time() && lr.msgid() >= 0)
+			{
+				double T; int sys;
+				gpulog::logrecord hdr = lr;
+				query::get_Tsys(hdr, T, sys);
+				segments.add_time(T);
+			}
+			if(block_size == 0)
+			{
+				output->write(lr.ptr, lr.len());
+				segments.add(lr.len());
+				continue;
+			}
+
+			// records never straddle two blocks
+			if(!block.empty() && sizeof(block_hdr) + block.size() + lr.len() > block_size)
+			{
+				write_block();
+			}
+
+			block.insert(block.end(), lr.ptr, lr.ptr + lr.len());
+
+			// system-defined records do not have a (T,sys) heading
+			if(lr.msgid() < 0) { block_hdr.nrecords++; continue; }
+
+			double T; int sys;
+			query::get_Tsys(lr, T, sys);
+			block_hdr.add(T, sys);
+		}
+	}
+
+protected:
+	//! Open a log file and write its header
+	void open_output(const std::string &fn)
+	{
+		output.reset(new std::ofstream(fn.c_str()));
+		if(!*output)
+			ERROR("Could not open '" + fn + "' for writing");
+
+		// write header
+		swarm::swarm_header fh(block_size != 0 ? query::BLOCKED_HEADER_FULL : query::UNSORTED_HEADER_FULL);
+		output->write((char*)&fh, sizeof(fh));
+	}
+
+	//! Finish the current segment and continue in a new one
+	void rotate()
+	{
+		write_block();
+		open_output(segments.next());
+
+		// segments are self-contained, compact snapshots never refer to an earlier segment
+		if(encoder.get() != NULL) { encoder->reset(); }
+	}
+
+	//! Write out the current block padded to block_size and start a new one
+	void write_block()
+	{
+		if(block.empty()) { return; }
+
+		block_hdr.datalen = block.size();
+		block_hdr.size = std::max<uint64_t>(block_size, sizeof(block_hdr) + block.size());
+		output->write((char*)&block_hdr, sizeof(block_hdr));
+		output->write(&block[0], block.size());
+
+		block.assign(block_hdr.size - sizeof(block_hdr) - block.size(), 0);
+		if(!block.empty()) { output->write(&block[0], block.size()); }
+		segments.add(block_hdr.size);
+
+		block.clear();
+		block_hdr = swarm_block_header();
 	}
 };
 
@@ -0,0 +1,205 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file compressed_writer.cpp
+ *    \brief Defines and implements a writer that writes block-compressed binary files.
+ *
+ *
+ */
+
+#include "../common.hpp"
+
+#include "../types/config.hpp"
+#include "../plugin.hpp"
+
+#include "io.hpp"
+#include "writer.h"
+#include "snapshot_codec.hpp"
+#include "compression.hpp"
+#include "segments.hpp"
+
+namespace swarm { namespace log {
+
+/**
+ *   \brief A writer plugin that writes block-compressed binary files.
+ *
+ *   To use this, add following lines to your integration configuration file
+ *
+ *   log_writer = compressed
+ *   log_output = <fileName>
+ *
+ *   The records are grouped in blocks of log_block_size bytes (1MB by
+ *   default) and every block is compressed on its own with the codec
+ *   given by log_compression (lz4 or zstd). A block offset table is
+ *   appended when the writer is closed. swarmdb decompresses the blocks
+ *   on demand, so the output can be queried like a plain binary log.
+ *
+ *   If log_segment_size or log_segment_time is set, the output is
+ *   split into segments (see log_segments).
+ *
+ */
+class compressed_writer : public writer
+{
+protected:
+	std::auto_ptr<std::ostream> output;
+	std::string rawfn, binfn;
+
+	codec_t codec;
+	int level;
+	size_t block_size;
+
+	//! Records of the block that is currently being filled
+	std::vector<char> block;
+	swarm_block_header block_hdr;
+	//! Encoder of compact snapshots, NULL if snapshots are stored in full
+	std::auto_ptr<snapshot_encoder> encoder;
+	//! Compressed data of the last block
+	std::vector<char> cblock;
+	//! Block offset table
+	std::vector<uint64_t> offsets;
+	uint64_t at;
+	log_segments segments;
+
+//! Constructor
+public:
+	compressed_writer(const config &cfg) : at(0), segments(cfg)
+	{
+		binfn = cfg.at("log_output");
+		if(binfn=="")
+			ERROR("Expected filename for writer.")
+		rawfn = binfn + ".raw";
+
+		codec = codec_for_name(cfg.optional("log_compression", std::string("default")));
+		if(!codec_available(codec))
+			ERROR(std::string("Compression codec ") + codec_name(codec) + " is not compiled in");
+		level = cfg.optional("log_compression_level", 0);
+
+		block_size = cfg.optional("log_block_size", 1024*1024);
+		if(block_size < 16*sizeof(swarm_block_header))
+			ERROR("log_block_size is too small.");
+		block.reserve(block_size);
+		encoder.reset(snapshot_encoder::create(cfg));
+
+		open_output(segments.enabled() ? segments.next() : rawfn);
+	}
+
+	//! Write the last block and the block offset table
+	~compressed_writer()
+	{
+		close_output();
+	}
+
+        //! Process the log data and write to output
+	virtual void process(const char *log_data, size_t length)
+	{
+		if(segments.full()) { rotate(); }
+
+		gpulog::ilogstream ils(log_data, length);
+		gpulog::logrecord lr;
+		while(lr = ils.next())
+		{
+			if(encoder.get() != NULL) { lr = encoder->encode(lr); }
+
+			// records never straddle two blocks
+			if(!block.empty() && sizeof(block_hdr) + block.size() + lr.len() > block_size)
+			{
+				write_block();
+			}
+
+			block.insert(block.end(), lr.ptr, lr.ptr + lr.len());
+
+			// system-defined records do not have a (T,sys) heading
+			if(lr.msgid() < 0) { block_hdr.nrecords++; continue; }
+
+			double T; int sys;
+			query::get_Tsys(lr, T, sys);
+			block_hdr.add(T, sys);
+			segments.add_time(T);
+		}
+	}
+
+protected:
+	//! Open a log file and write its header
+	void open_output(const std::string &fn)
+	{
+		output.reset(new std::ofstream(fn.c_str()));
+		if(!*output)
+			ERROR("Could not open '" + fn + "' for writing");
+
+		// write header, the codec goes in the flags
+		swarm::swarm_header fh(query::COMPRESSED_HEADER_FULL, codec);
+		output->write((char*)&fh, sizeof(fh));
+	}
+
+	//! Write the last block and the block offset table of the file
+	void close_output()
+	{
+		write_block();
+
+		if(!offsets.empty()) { output->write((char*)&offsets[0], offsets.size()*sizeof(uint64_t)); }
+		swarm_block_table_trailer trailer(offsets.size());
+		output->write((char*)&trailer, sizeof(trailer));
+
+		output.reset(NULL);
+	}
+
+	//! Finish the current segment and continue in a new one
+	void rotate()
+	{
+		close_output();
+		offsets.clear();
+		at = 0;
+		open_output(segments.next());
+
+		// segments are self-contained, compact snapshots never refer to an earlier segment
+		if(encoder.get() != NULL) { encoder->reset(); }
+	}
+
+	//! Compress and write out the current block and start a new one
+	void write_block()
+	{
+		if(block.empty()) { return; }
+
+		cblock.resize(compress_bound(codec, block.size()));
+		size_t clen = compress_block(codec, &cblock[0], cblock.size(), &block[0], block.size(), level);
+
+		// keep the blocks 16-byte aligned
+		static const char zeros[16] = { 0 };
+		size_t pad = (16 - clen % 16) % 16;
+
+		block_hdr.datalen = block.size();
+		block_hdr.clen = clen;
+		block_hdr.size = sizeof(block_hdr) + clen + pad;
+		output->write((char*)&block_hdr, sizeof(block_hdr));
+		output->write(&cblock[0], clen);
+		output->write(zeros, pad);
+
+		offsets.push_back(at);
+		at += block_hdr.size;
+		segments.add(block_hdr.size);
+
+		block.clear();
+		block_hdr = swarm_block_header();
+	}
+};
+
+//! Initialize the compressed writer plugin
+writer_plugin_initializer< compressed_writer >
+	compressed_writer_plugin("compressed", "This is the block-compressed binary writer");
+
+} }
@@ -0,0 +1,143 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file compression.cpp
+ *    \brief Implements the block compression codecs used by compressed log files.
+ *
+ *
+ */
+
+#include "compression.hpp"
+
+#ifdef SWARM_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef SWARM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace swarm { namespace log {
+
+codec_t codec_for_name(const std::string &name)
+{
+	if(name == "default")
+		return codec_available(CODEC_LZ4) ? CODEC_LZ4 : CODEC_ZSTD;
+	if(name == "lz4")  return CODEC_LZ4;
+	if(name == "zstd") return CODEC_ZSTD;
+	if(name == "none") return CODEC_NONE;
+	ERROR("Unknown compression codec '" + name + "'");
+}
+
+const char *codec_name(codec_t codec)
+{
+	switch(codec)
+	{
+	case CODEC_NONE: return "none";
+	case CODEC_LZ4:  return "lz4";
+	case CODEC_ZSTD: return "zstd";
+	}
+	return "unknown";
+}
+
+bool codec_available(codec_t codec)
+{
+	switch(codec)
+	{
+	case CODEC_NONE: return true;
+#ifdef SWARM_HAVE_LZ4
+	case CODEC_LZ4:  return true;
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	case CODEC_ZSTD: return true;
+#endif
+	default:         return false;
+	}
+}
+
+size_t compress_bound(codec_t codec, size_t len)
+{
+	switch(codec)
+	{
+#ifdef SWARM_HAVE_LZ4
+	case CODEC_LZ4:  return LZ4_compressBound(len);
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	case CODEC_ZSTD: return ZSTD_compressBound(len);
+#endif
+	case CODEC_NONE: return len;
+	default:
+		ERROR(std::string("Compression codec ") + codec_name(codec) + " is not compiled in");
+	}
+}
+
+size_t compress_block(codec_t codec, char *dst, size_t dstlen, const char *src, size_t len, int level)
+{
+	switch(codec)
+	{
+#ifdef SWARM_HAVE_LZ4
+	case CODEC_LZ4:
+		{
+			// for LZ4 the level is the acceleration factor, higher is faster
+			int clen = LZ4_compress_fast(src, dst, len, dstlen, std::max(level, 1));
+			if(clen <= 0) ERROR("LZ4 compression failed");
+			return clen;
+		}
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	case CODEC_ZSTD:
+		{
+			size_t clen = ZSTD_compress(dst, dstlen, src, len, level != 0 ? level : 1);
+			if(ZSTD_isError(clen)) ERROR(std::string("Zstd compression failed: ") + ZSTD_getErrorName(clen));
+			return clen;
+		}
+#endif
+	case CODEC_NONE:
+		assert(dstlen >= len);
+		memcpy(dst, src, len);
+		return len;
+	default:
+		ERROR(std::string("Compression codec ") + codec_name(codec) + " is not compiled in");
+	}
+}
+
+void decompress_block(codec_t codec, char *dst, size_t len, const char *src, size_t clen)
+{
+	switch(codec)
+	{
+#ifdef SWARM_HAVE_LZ4
+	case CODEC_LZ4:
+		if(LZ4_decompress_safe(src, dst, clen, len) != (int)len)
+			ERROR("Corrupted LZ4 block in log file");
+		return;
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	case CODEC_ZSTD:
+		if(ZSTD_decompress(dst, len, src, clen) != len)
+			ERROR("Corrupted Zstd block in log file");
+		return;
+#endif
+	case CODEC_NONE:
+		if(clen != len) ERROR("Corrupted block in log file");
+		memcpy(dst, src, len);
+		return;
+	default:
+		ERROR(std::string("Compression codec ") + codec_name(codec) + " is not compiled in");
+	}
+}
+
+} }
@@ -0,0 +1,51 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file compression.hpp
+ *    \brief Defines the block compression codecs used by compressed log files.
+ *
+ *
+ */
+
+#pragma once
+#include "../common.hpp"
+
+namespace swarm { namespace log {
+
+//! Compression codecs, the codec of a compressed log file is stored in swarm_header::flags
+enum codec_t { CODEC_NONE = 0, CODEC_LZ4 = 1, CODEC_ZSTD = 2 };
+
+//! Find the codec by name ("lz4", "zstd" or "none"), "default" picks the fastest available one
+codec_t codec_for_name(const std::string &name);
+
+//! Name of the codec
+const char *codec_name(codec_t codec);
+
+//! Test if the codec is compiled in
+bool codec_available(codec_t codec);
+
+//! Maximum compressed size of len bytes
+size_t compress_bound(codec_t codec, size_t len);
+
+//! Compress len bytes from src into dst, returns the compressed size
+size_t compress_block(codec_t codec, char *dst, size_t dstlen, const char *src, size_t len, int level = 0);
+
+//! Decompress clen bytes from src into dst, which must have room for exactly len bytes
+void decompress_block(codec_t codec, char *dst, size_t len, const char *src, size_t clen);
+
+} }
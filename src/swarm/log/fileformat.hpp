@@ -67,15 +67,139 @@ namespace swarm {
 		}
 	};
 
-	//! Define swarm index header. It _MUST_ be padded to 16-byte boundary
+	/*! Header of one block in a block-framed log file. It _MUST_ be padded to 16-byte boundary
+	 *
+	 * A block-framed file is a swarm_header followed by a sequence of blocks.
+	 * Each block is this header, datalen bytes of back-to-back log records and
+	 * zero padding up to size bytes. The header summarizes the records so
+	 * readers can skip the block or process it independently of the others.
+	 */
+	struct ALIGN(16) swarm_block_header
+	{
+		char magic[4];		//!< Magic string to verify the block boundary (== 'BLK\0')
+		uint32_t nrecords;	//!< number of log records in the block
+		uint64_t size;		//!< size of the block, including this header and the padding
+		uint64_t datalen;	//!< length of the log records in the block
+		uint64_t clen;		//!< length of the compressed records, 0 if the block is not compressed
+		double Tmin, Tmax;	//!< time range of the records in the block
+		int32_t sysmin, sysmax;	//!< system id range of the records in the block
+
+		//! Constructor for an empty block
+		swarm_block_header()
+		{
+			strcpy(magic, "BLK");
+			nrecords = 0;
+			size = datalen = clen = 0;
+			Tmin = std::numeric_limits<double>::max(); Tmax = -Tmin;
+			sysmin = std::numeric_limits<int32_t>::max(); sysmax = std::numeric_limits<int32_t>::min();
+		}
+
+		//! Check the magic string
+		bool is_valid() const { return memcmp(magic, "BLK", 4) == 0; }
+
+		//! Extend the ranges to include a record at time T for system sys
+		void add(double T, int sys)
+		{
+			nrecords++;
+			Tmin = std::min(Tmin, T); Tmax = std::max(Tmax, T);
+			sysmin = std::min(sysmin, sys); sysmax = std::max(sysmax, sys);
+		}
+	};
+
+	/*! Trailer of a block-compressed log file. It _MUST_ be padded to 16-byte boundary
+	 *
+	 * The trailer is preceded by the block offset table: nblocks offsets
+	 * (uint64_t, relative to the end of the swarm_header) of the block headers.
+	 * Files without a trailer (e.g. still being written) are read by
+	 * walking the block headers.
+	 */
+	struct ALIGN(16) swarm_block_table_trailer
+	{
+		char magic[8];		//!< Magic string (== 'BLKTAB\0\0')
+		uint64_t nblocks;	//!< number of entries in the block offset table
+
+		//! Constructor for the trailer
+		swarm_block_table_trailer(uint64_t nblocks_ = 0) : nblocks(nblocks_)
+		{
+			memset(magic, 0, sizeof(magic));
+			strcpy(magic, "BLKTAB");
+		}
+
+		//! Check the magic string
+		bool is_valid() const { return memcmp(magic, "BLKTAB\0\0", 8) == 0; }
+	};
+
+	/*! Define swarm index header. It _MUST_ be padded to 16-byte boundary
+	 *
+	 * Index files have format version 3, the entries hold the event ids
+	 * of the records. The records of the data file up to data_indexed
+	 * are in the index, so an index of a data file that has grown since
+	 * can be brought up to date by indexing the rest. data_fingerprint
+	 * tells whether the data up to data_indexed is still the same.
+	 */
 	struct ALIGN(16) swarm_index_header : public swarm_header
 	{
 		uint64_t	timestamp;	// datafile timestamp (mtime)
 		uint64_t	datafile_size;	// datafile file size
+		uint64_t	data_indexed;	// (uncompressed) data offset up to which the records are indexed
+		uint64_t	data_fingerprint;	// fingerprint of the data up to data_indexed
+
+		swarm_index_header(const std::string &type, uint64_t timestamp_ = 0, uint64_t datafile_size_ = 0 , uint64_t data_indexed_ = 0, uint64_t data_fingerprint_ = 0, uint64_t datalen_ = npos)
+			: swarm_header(type, 0, datalen_), timestamp(timestamp_), datafile_size(datafile_size_), data_indexed(data_indexed_), data_fingerprint(data_fingerprint_)
+		{
+			strcpy(version, "3");
+		}
+	};
+
+	/*! One row of a binary or columnar export of swarm query: a body of a
+	 * snapshot or ejection record, or another event. The columns of the
+	 * coordinates are x, y, z, vx, vy, vz or, with Keplerian output,
+	 * a, e, i, O, w, M (angles in degrees). Events without a body state
+	 * have NaN mass and coordinates.
+	 */
+	struct swarm_export_row
+	{
+		double	time;
+		int32_t	evt, sys, body, flags;
+		double	mass;
+		double	c[6];
+	};
+
+	/*! Header of a binary or columnar export of swarm query. It _MUST_ be padded to 16-byte boundary
+	 *
+	 * The header is followed by ncolumns swarm_export_column entries. In a
+	 * binary export ("query_rows") they are followed by the rows, each a
+	 * swarm_export_row. In a columnar export ("query_columns") each column
+	 * is an array of nrows values at the offset given in its entry.
+	 */
+	struct ALIGN(16) swarm_export_header : public swarm_header
+	{
+		uint64_t	nrows;		// number of rows (npos if the rows run up to the end of the file)
+		uint32_t	ncolumns;	// number of swarm_export_column entries
+		uint32_t	rowsize;	// size of a row (sizeof(swarm_export_row))
+
+		swarm_export_header(const std::string &type, uint32_t ncolumns_ = 0, uint64_t nrows_ = npos)
+			: swarm_header(type), nrows(nrows_), ncolumns(ncolumns_), rowsize(sizeof(swarm_export_row))
+		{
+		}
+	};
+
+	//! Description of one column of a binary or columnar export. It _MUST_ be padded to 16-byte boundary
+	struct ALIGN(16) swarm_export_column
+	{
+		char		name[8];	// column name (e.g. "time", "x" or "a")
+		char		type[4];	// type of the values, as a numpy dtype ("<i4" or "<f8")
+		uint32_t	size;		// size of a value
+		uint64_t	offset;		// offset of the value in a row, or of the array in a columnar file
 
-		swarm_index_header(const std::string &type, uint64_t timestamp_ = 0, uint64_t datafile_size_ = 0 , uint64_t datalen_ = npos)
-			: swarm_header(type, 0, datalen_), timestamp(timestamp_), datafile_size(datafile_size_)
+		swarm_export_column(const char *name_ = "", const char *type_ = "", uint32_t size_ = 0, uint64_t offset_ = 0)
 		{
+			// clear the padding too, the entries are written to the file as they are
+			memset(this, 0, sizeof(*this));
+			strncpy(name, name_, sizeof(name)-1);
+			strncpy(type, type_, sizeof(type)-1);
+			size = size_;
+			offset = offset_;
 		}
 	};
 
@@ -0,0 +1,137 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file filter.cpp
+ *    \brief Implements the filter stage of the logging manager.
+ *
+ *
+ */
+
+#include "filter.hpp"
+
+namespace swarm { namespace log {
+
+//! Parse a single value of a range, MIN and MAX stand for the limits
+template<typename T>
+static T parse_range_value(const std::string &s, const std::string &name)
+{
+	if(s == "MIN") { return query::MIN; }
+	if(s == "MAX") { return query::MAX; }
+
+	std::istringstream in(s);
+	T v;
+	if(!(in >> v) || !(in >> std::ws).eof())
+		ERROR("Invalid range '" + s + "' for " + name);
+	return v;
+}
+
+//! Parse a range of the form <r1>..<r2>, <r1> or ALL
+template<typename T>
+static query::range<T> parse_range(const std::string &s, const std::string &name)
+{
+	if(s == "ALL") { return query::range<T>(query::ALL); }
+
+	size_t dots = s.find("..");
+	if(dots == std::string::npos)
+	{
+		return query::range<T>(parse_range_value<T>(s, name));
+	}
+	return query::range<T>(parse_range_value<T>(s.substr(0, dots), name), parse_range_value<T>(s.substr(dots + 2), name));
+}
+
+//!
+filter::filter(const config &cfg)
+{
+	if(cfg.count("log_filter_events"))
+	{
+		std::string list = cfg.at("log_filter_events");
+		std::replace(list.begin(), list.end(), ',', ' ');
+		std::istringstream in(list);
+		int msgid;
+		while(in >> msgid)
+		{
+			if(msgid < 0)
+				ERROR("log_filter_events takes non-negative event ids");
+			if(msgid >= events.size()) { events.resize(msgid + 1, false); }
+			events[msgid] = true;
+		}
+		if(!in.eof())
+			ERROR("Invalid event id list '" + cfg.at("log_filter_events") + "' for log_filter_events");
+	}
+
+	systems = parse_range<int>(cfg.optional("log_filter_systems", std::string("ALL")), "log_filter_systems");
+	times = parse_range<double>(cfg.optional("log_filter_time", std::string("ALL")), "log_filter_time");
+
+	snapshot_every = cfg.optional("log_filter_snapshot_every", 1);
+	if(snapshot_every < 1)
+		ERROR("log_filter_snapshot_every must be positive");
+}
+
+//!
+filter *filter::create(const config &cfg)
+{
+	const char *options[] = { "log_filter_events", "log_filter_systems", "log_filter_time", "log_filter_snapshot_every" };
+	for(int i = 0; i != sizeof(options)/sizeof(options[0]); i++)
+	{
+		if(cfg.count(options[i])) { return new filter(cfg); }
+	}
+	return NULL;
+}
+
+//! Test if the record passes the filter
+bool filter::keep(gpulog::logrecord lr)
+{
+	const int msgid = lr.msgid();
+	if(msgid < 0) { return true; }
+
+	if(!events.empty() && (msgid >= events.size() || !events[msgid])) { return false; }
+
+	double T; int sys;
+	query::get_Tsys(lr, T, sys);
+	if(!systems.in(sys) || !times.in(T)) { return false; }
+
+	if(snapshot_every > 1 && msgid == EVT_SNAPSHOT && sys >= 0)
+	{
+		if(sys >= snapshot_count.size()) { snapshot_count.resize(sys + 1, 0); }
+		if(snapshot_count[sys]++ % snapshot_every != 0) { return false; }
+	}
+
+	return true;
+}
+
+//!
+size_t filter::apply(char *log_data, size_t length)
+{
+	gpulog::ilogstream ils(log_data, length);
+	gpulog::logrecord lr;
+	size_t at = 0;
+	while(lr = ils.next())
+	{
+		if(!keep(lr)) { continue; }
+
+		// records only ever move towards the beginning of the buffer
+		if(lr.ptr != log_data + at)
+		{
+			memmove(log_data + at, lr.ptr, lr.len());
+		}
+		at += lr.len();
+	}
+	return at;
+}
+
+} }
@@ -0,0 +1,70 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file filter.hpp
+ *    \brief Defines the filter stage of the logging manager.
+ *
+ *
+ */
+
+#pragma once
+#include "../common.hpp"
+#include "../types/config.hpp"
+
+#include "io.hpp"
+
+namespace swarm { namespace log {
+
+/**
+ *   \brief Drops unwanted records from the log before it reaches the writer.
+ *
+ *   The filter is configured with following options:
+ *    - log_filter_events : comma-separated list of event ids to keep
+ *    - log_filter_systems : range of system ids to keep (e.g. 0..99)
+ *    - log_filter_time : time window to keep (e.g. 10..MAX)
+ *    - log_filter_snapshot_every : keep only every n-th snapshot of each system
+ *
+ *   System-defined records (negative msgid) are always kept. The records
+ *   are removed from the host buffer in place, so records that are
+ *   filtered out are never serialized, compressed or indexed.
+ */
+class filter
+{
+	//! events[msgid] is true if the event is kept, empty to keep all events
+	std::vector<bool> events;
+	query::sys_range_t systems;
+	query::time_range_t times;
+	int snapshot_every;
+	//! number of snapshots seen for each system
+	std::vector<int> snapshot_count;
+
+	bool keep(gpulog::logrecord lr);
+
+public:
+	filter(const config &cfg);
+
+	//! Remove the records that are filtered out, returns the length of the remaining data
+	size_t apply(char *log_data, size_t length);
+
+	//! Create a filter from the configuration, NULL if there is nothing to filter
+	static filter *create(const config &cfg);
+};
+
+typedef shared_ptr<filter> Pfilter;
+
+} }
@@ -162,6 +162,8 @@ namespace gpulog
 		char *buffer;
 		int *at;
 		int buf_len;
+		//! separate log receiving printf records (NULL if they go to this log)
+		log_base<A> *printf_log;
 
 	public: /* manipulation from host */
 	        //!
@@ -204,6 +206,12 @@ namespace gpulog
 			A::set(at, pos);
 		}
 
+	        //! route printf records to log l instead of this log
+		__host__ void set_printf_channel(log_base<A> *l)
+		{
+			printf_log = l;
+		}
+
 	public: 
 	        //! manipulation from device 
 		__host__ __device__ int capacity() const
@@ -229,6 +237,12 @@ namespace gpulog
 			return buffer;
 		}
 
+	        //! log that printf records should be written to (used by lprintf())
+		__host__ __device__ log_base<A>& printf_channel()
+		{
+			return printf_log != NULL ? *printf_log : *this;
+		}
+
 		//! test if the buffer has overflowed
 		__host__ __device__ inline bool has_overflowed(int idx)
 		{
@@ -277,6 +291,7 @@ namespace gpulog
 	{
 		host_log(size_t len = 0)
 		{
+			printf_log = NULL;
 			alloc(len);
 		}
 
@@ -384,15 +399,21 @@ namespace gpulog
 	inline device_log alloc_device_log(const char *symbol, size_t len)
 	{
 		device_log dlog;
+		dlog.set_printf_channel(NULL);
 		dlog.alloc(len);
 		upload_device_log(symbol, dlog);
 		return dlog;
 	}
 
 	//! Setup a new log object and return the device pointer
-	inline device_log* alloc_device_log(size_t len)
+	//!
+	//! If printf_log is given (a device pointer returned by an earlier
+	//! call), printf records are written there instead of to the new log
+	//!
+	inline device_log* alloc_device_log(size_t len, device_log *printf_log = NULL)
 	{
 		device_log dlog;
+		dlog.set_printf_channel(printf_log);
 		dlog.alloc(len);
 		return upload_device_log(dlog);
 	}
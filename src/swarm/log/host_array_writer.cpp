@@ -35,10 +35,61 @@
 
 namespace swarm { namespace log {
 
+  //! Preallocate space for n events
+  void event_table::reserve(const size_t n)
+  {
+    _sys.reserve(n);
+    _time.reserve(n);
+    _bodid1.reserve(n);
+    _bodid2.reserve(n);
+    _data.reserve(n*num_data);
+  }
+
+  //! Group the rows by system and find the first row of every system
+  void event_table::group_by_system()
+  {
+    if(grouped_rows == size()) return;
+
+    int nsys = 0;
+    for(size_t e=0;e<size();++e)
+      nsys = std::max(nsys, _sys[e]+1);
+
+    // count the events of every system
+    sys_offsets.assign(nsys+1, 0);
+    for(size_t e=0;e<size();++e)
+      ++sys_offsets[_sys[e]+1];
+    for(int s=0;s<nsys;++s)
+      sys_offsets[s+1] += sys_offsets[s];
+
+    if(!in_order)
+      {
+	// stable counting sort of all the columns
+	std::vector<size_t> next(sys_offsets.begin(), sys_offsets.end()-1);
+	std::vector<int> sys(size()), bodid1(size()), bodid2(size());
+	std::vector<double> time(size()), data(_data.size());
+	for(size_t e=0;e<size();++e)
+	  {
+	    size_t to = next[_sys[e]]++;
+	    sys[to] = _sys[e];
+	    time[to] = _time[e];
+	    bodid1[to] = _bodid1[e];
+	    bodid2[to] = _bodid2[e];
+	    std::copy(&_data[e*num_data], &_data[e*num_data] + num_data, &data[0] + to*num_data);
+	  }
+	_sys.swap(sys); _time.swap(time);
+	_bodid1.swap(bodid1); _bodid2.swap(bodid2);
+	_data.swap(data);
+	in_order = true;
+      }
+
+    grouped_rows = size();
+  }
+
   //! Implement the constructor
   host_array_writer::host_array_writer(const config &cfg) : event_codes_to_log(0), event_log(0)
   {
     debug = cfg.optional<int>("debug_host_array_writer",0);
+    reserve = cfg.optional<int>("host_array_reserve",0);
     // eventually figure out how to set multiple event types
     int event_type = cfg.require<int>("host_array_event_type");
     if(event_type!=0) 
@@ -54,10 +105,9 @@ namespace swarm { namespace log {
     //! 
   void host_array_writer::add_event_type_to_log(const int et)
   {
-    //    int size = event_codes_to_log.size();
-    //    event_code_index[et] = size;
     event_codes_to_log.push_back(et);
-    event_log.resize(event_codes_to_log.size());
+    event_log.push_back(event_table(log::num_doubles_for_event(et)));
+    event_log.back().reserve(reserve);
   }
   
     //! Process the log data
@@ -68,41 +118,28 @@ namespace swarm { namespace log {
     gpulog::logrecord lr;
     while(lr = ils.next()) 
       {
-	bool need_to_log = false;
 	int event_code = lr.msgid();
 	for(int i=0;i<event_codes_to_log.size();++i)
 	  {
 	    if(event_codes_to_log[i]!=event_code) continue;
-	    need_to_log = true;
 	    
 	    double time;
 	    int sysid;
 	    lr >> time >> sysid;
-	    if(sysid>=event_log[i].size()) event_log[i].resize(sysid+1);
 	    
 	    // \todo Add code for how to process other observations-type events here
-	    //	    if((event_code==EVT_TRANSIT)||(event_code==EVT_OCCULTATION)) 
-
-	    //	 int event_id = (depth>0.) ? log::EVT_TRANSIT : log::EVT_OCCULTATION;
-	    //	 log::event(_log,event_id,_sys.time()+dt_min_b2,_sys.id(),j,b,vproj);
-
 	    if((event_code>=log::EVT_FIRST_OBS_CODE)&&(event_code<=log::EVT_LAST_OBS_CODE)) 
 	      {
 		int num_ints = log::num_ints_for_event(event_code);
 		int num_doubles = log::num_doubles_for_event(event_code);
-		std::vector<int>    intdata(num_ints,-1);
-		std::vector<double> doubledata(num_doubles,-1.);
+		int    intdata[max_num_ints_per_event] = { -1, -1 };
+		double doubledata[max_num_doubles_per_event];
 		for(int j=0;j<num_ints;++j)
 		  lr >> intdata[j];
 		for(int j=0;j<num_doubles;++j)
 		  lr >> doubledata[j];
 		if(num_doubles>0)
-		  {
-		    if(num_ints==1)
-		      event_log[i][sysid].push_back(event_record_type(intdata[0],time,&doubledata[0]));
-		    else if (num_ints==2)
-		      event_log[i][sysid].push_back(event_record_type(intdata[0],intdata[1],time,&doubledata[0]));
-		  }
+		  event_log[i].append(sysid,time,intdata[0],intdata[1],doubledata);
 
 		++events_added;
 		if(debug)
@@ -34,88 +34,91 @@
 #include "writer.h"
 
 namespace swarm { namespace log {
-//! Define event_record class
-template<int NumData>
-class event_record
-{
-public:
-  typedef double data_type[NumData];
-  int bodid1, bodid2;
-  double time;
-  data_type data;
-  event_record(const int b, const double t, const double* d)
-    : bodid1(b), bodid2(-1), time(t)
-  {
-    for(int i=0;i<NumData;++i) data[i] = d[i];
-  }
 
-  //! Constructor
-  event_record(const int b1, const int b2, const double t, const double* d)
-    : bodid1(b1), bodid2(b2), time(t)
-  {
-    for(int i=0;i<NumData;++i) data[i] = d[i];
-  }
-
-  //! Get number of data records
-  int get_num_data() const 
-  { return NumData;  };
-
-};
-
-/// Specialized version for NumData=-1 to allow for variable length
-template<>  class event_record<-1>
+/**
+ *  \brief Events of one type stored in columns.
+ *
+ *  Every event is a row of the columns sys, time, bodid1, bodid2 and
+ *  get_num_data() doubles in data (stored row after row). Rows are
+ *  appended in the order the events arrive. Looking up a system groups
+ *  the rows by system (a stable counting sort, skipped if the rows are
+ *  in order already), after which the events of system sys are the
+ *  rows [begin(sys), end(sys)).
+ */
+class event_table
 {
-public:
-  typedef std::vector<double> data_type;
-  int bodid1, bodid2;
-  double time;
-  data_type data;
-
-  //! Constructor for specialized version for NumData = -1
-  event_record(const int b, const double t, const data_type& d)
-    : bodid1(b), bodid2(-1), time(t), data(d.size())
-  {
-    for(int i=0;i<data.size();++i) data[i] = d[i];
-  }
+  int num_data;
+  std::vector<int> _sys, _bodid1, _bodid2;
+  std::vector<double> _time, _data;
 
-  //! Constructor
-  event_record(const int b1, const int b2, const double t, const data_type& d)
-    : bodid1(b1), bodid2(b2), time(t), data(d.size())
-  {
-    for(int i=0;i<data.size();++i) data[i] = d[i];
-  }
+  //! first row of every system (and one past the last row), valid for the first grouped_rows rows
+  std::vector<size_t> sys_offsets;
+  size_t grouped_rows;
+  //! whether the rows are ordered by system
+  bool in_order;
 
-  //! Get number of data records
-  int get_num_data() const 
-  {       return data.size();    }
-};
+  void group_by_system();
 
-/// Specialized version for NumData=0 to allow for no double data (is this needed?)
-template<>  class event_record<0>
-{
 public:
-  typedef std::vector<double> data_type;
-  int bodid1, bodid2;
-  double time;
+  //! Constructor for a table with num_data doubles per event
+  event_table(const int num_data_ = 0)
+    : num_data(num_data_), grouped_rows(0), in_order(true)
+  {}
 
-  //! Constructor for event_record for NumData=0
-  event_record(const int b, const double t)
-    : bodid1(b), bodid2(-1), time(t)
-  {  }
+  //! Preallocate space for n events
+  void reserve(const size_t n);
 
-  //! Constructor
-  event_record(const int b1, const int b2, const double t)
-    : bodid1(b1), bodid2(b2), time(t)
-  {  }
+  //! Number of events
+  size_t size() const
+  {    return _time.size();  }
 
-  //! Get number of data records
+  //! Number of doubles per event
   int get_num_data() const 
-  {       return 0;    }
+  {    return num_data;  }
+
+  //! Add an event, d points to get_num_data() doubles
+  void append(const int sys, const double time, const int bodid1, const int bodid2, const double* d)
+  {
+    if(!_sys.empty() && sys < _sys.back()) in_order = false;
+    _sys.push_back(sys);
+    _time.push_back(time);
+    _bodid1.push_back(bodid1);
+    _bodid2.push_back(bodid2);
+    _data.insert(_data.end(), d, d + num_data);
+  }
+
+  //! Number of systems (one more than the largest system id)
+  int nsys()
+  {    group_by_system(); return sys_offsets.size() - 1;  }
+
+  //! First row of system sys
+  size_t begin(const int sys)
+  {    group_by_system(); return (sys>=0 && sys<nsys()) ? sys_offsets[sys] : size();  }
+
+  //! One past the last row of system sys
+  size_t end(const int sys)
+  {    group_by_system(); return (sys>=0 && sys<nsys()) ? sys_offsets[sys+1] : size();  }
+
+  int sys(const size_t e) const
+  {    return _sys[e];  }
+  double time(const size_t e) const
+  {    return _time[e];  }
+  int bodid1(const size_t e) const
+  {    return _bodid1[e];  }
+  int bodid2(const size_t e) const
+  {    return _bodid2[e];  }
+  //! Doubles of event e
+  const double* data(const size_t e) const
+  {    return &_data[e*num_data];  }
 };
 
 /**
  *  A writer plugin that keeps the data in the memory.
  *
+ *  The events of every type that is logged go to an event_table. If
+ *  host_array_reserve is set, each table preallocates space for that
+ *  many events.
+ *
  *  *EXPERIMENTAL*: This class is not thoroughly tested.
  * 
  *
@@ -123,13 +126,12 @@ public:
 class host_array_writer : public writer
 {
 public: 
-  static const int max_num_doubles_per_event = 2;
-  typedef event_record<max_num_doubles_per_event> event_record_type;
+  static const int max_num_ints_per_event = 2;
+  static const int max_num_doubles_per_event = 3;
 protected:
   std::vector<int> event_codes_to_log;
-  typedef std::vector<event_record_type>  event_log_one_system_type;
-  typedef std::vector<event_log_one_system_type>  event_log_one_code_type;
-  std::vector<event_log_one_code_type> event_log;
+  std::vector<event_table> event_log;
+  size_t reserve;
   int debug;
 
 public:
@@ -140,22 +142,14 @@ public:
   //! Add the event type to the log
   void add_event_type_to_log(const int et);
   
-  //!
-  event_log_one_code_type& get_event_log_all_systems(const int i)
+  //! Events of the i-th event type that is logged
+  event_table& get_event_log(const int i)
   {    return event_log[i];  }
 
-  //!
-  const event_log_one_code_type& get_event_log_all_systems(const int i) const
+  //! Events of the i-th event type that is logged
+  const event_table& get_event_log(const int i) const
   {    return event_log[i];  }
 
-  //!
-  event_log_one_system_type& get_event_log(const int i, const int sys)
-  {    return event_log[i][sys];  }
-
-  //!
-  const event_log_one_system_type& get_event_log(const int i, const int sys) const
-  {    return event_log[i][sys];  }
-
   //! 
   int get_event_type(const int i) const
   {    
@@ -24,6 +24,10 @@
 #include "../common.hpp"
 #include "io.hpp"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 using namespace swarm::log;
 
@@ -39,8 +43,18 @@ const char* UNSORTED_HEADER_FULL = "unsorted_output // Unsorted output file";
 const char* UNSORTED_HEADER_CHECK = "unsorted_output";
 const char* SORTED_HEADER_FULL = "T_sorted_output // Output file sorted by time";
 const char* SORTED_HEADER_CHECK = "T_sorted_output";
+const char* BLOCKED_HEADER_FULL = "blocked_output // Block-framed unsorted output file";
+const char* BLOCKED_HEADER_CHECK = "blocked_output";
+const char* COMPRESSED_HEADER_FULL = "compressed_output // Block-compressed unsorted output file";
+const char* COMPRESSED_HEADER_CHECK = "compressed_output";
 const char* T_INDEX_CHECK = "T_sorted_index";
 const char* SYS_INDEX_CHECK = "sys_sorted_index";
+const char* BODY_INDEX_CHECK = "body_sorted_index";
+const char* EVT_INDEX_CHECK = "evt_sorted_index";
+const char* ZONE_INDEX_CHECK = "zone_map";
+
+//! Length of the records summarized by one zone of an unframed log file
+static const uint64_t ZONE_SIZE = 256*1024;
 
 //!
 void get_Tsys(gpulog::logrecord &lr, double &T, int &sys)
@@ -57,51 +71,160 @@ void get_Tsys(gpulog::logrecord &lr, double &T, int &sys)
 	}
 }
 
+//! Open an unsorted log file and detect its layout
+log_file_format open_log_file(mmapped_swarm_file &mm, const std::string &datafile)
+{
+	mm.open(datafile, UNSORTED_HEADER_CHECK, MemoryMap::ro, false);
+
+	swarm_header unframed(UNSORTED_HEADER_CHECK), framed(BLOCKED_HEADER_CHECK), compressed(COMPRESSED_HEADER_CHECK);
+	if(framed.is_compatible(mm.hdr())) { return LOG_FRAMED; }
+	if(compressed.is_compatible(mm.hdr())) { return LOG_COMPRESSED; }
+	if(unframed.is_compatible(mm.hdr())) { return LOG_UNFRAMED; }
+
+	std::cerr << "Expecting: " << unframed.type() << ", " << framed.type() << " or " << compressed.type() << "\n";
+	std::cerr << "Got      : " << mm.hdr().type() << "\n";
+	throw peyton::system::MemoryMapError("Input file corrupted or incompatible with this version of swarm");
+}
+
+//! Check the block header at offset at and add it to the list of blocks
+static bool add_log_block(std::vector<log_block> &blocks, const mmapped_swarm_file &mm, log_file_format format, size_t at, size_t end)
+{
+	const swarm_block_header *h = (const swarm_block_header *)(mm.data() + at);
+	if(at + sizeof(*h) > end || !h->is_valid() || at + h->size > end
+		|| h->size < sizeof(*h) + (format == LOG_FRAMED ? h->datalen : h->clen))
+	{
+		// a block that is still being written or a truncated file
+		std::cerr << "Ignoring incomplete block at offset " << at << "\n";
+		return false;
+	}
+
+	log_block b;
+	b.offs  = blocks.empty() ? 0 : blocks.back().offs + blocks.back().len;
+	b.len   = h->datalen;
+	b.hdr   = h;
+	b.begin = NULL;
+	if(format == LOG_FRAMED)
+	{
+		b.begin = (const char *)&h[1];
+		b.offs  = b.begin - mm.data();
+	}
+	blocks.push_back(b);
+	return true;
+}
+
+//! Split a log file into blocks of records
+void get_log_blocks(std::vector<log_block> &blocks, const mmapped_swarm_file &mm, log_file_format format)
+{
+	blocks.clear();
+	if(format == LOG_UNFRAMED)
+	{
+		log_block b = { 0, mm.size(), NULL, mm.data() };
+		blocks.push_back(b);
+		return;
+	}
+
+	// use the block offset table of compressed files if it has been written
+	const swarm_block_table_trailer *t = (const swarm_block_table_trailer *)(mm.data() + mm.size()) - 1;
+	if(format == LOG_COMPRESSED && mm.size() >= sizeof(*t) && t->is_valid()
+		&& t->nblocks*sizeof(uint64_t) + sizeof(*t) <= mm.size())
+	{
+		const uint64_t *table = (const uint64_t *)t - t->nblocks;
+		size_t end = (const char *)table - mm.data();
+		for(uint64_t i = 0; i != t->nblocks; i++)
+		{
+			if(!add_log_block(blocks, mm, format, table[i], end)) { break; }
+		}
+		return;
+	}
+
+	// walk the block headers, the records themselves are not touched
+	size_t at = 0;
+	while(at < mm.size() && add_log_block(blocks, mm, format, at, mm.size()))
+	{
+		at += blocks.back().hdr->size;
+	}
+}
+
+//! Decompress the block (if it is not in the cache already)
+block_cache::Pbuffer block_cache::get(const log_block &b)
+{
+	Pbuffer buf;
+	#pragma omp critical(swarm_block_cache)
+	{
+		std::map<const swarm_block_header *, Pbuffer>::iterator i = blocks.find(b.hdr);
+		if(i != blocks.end()) { buf = i->second; }
+	}
+	if(buf) { return buf; }
+
+	// decompress outside of the critical section, other threads may
+	// decompress other blocks meanwhile
+	buf.reset(new std::vector<char>(std::max<size_t>(b.len, 1)));
+	log::decompress_block(codec, &(*buf)[0], b.len, (const char *)&b.hdr[1], b.hdr->clen);
+
+	#pragma omp critical(swarm_block_cache)
+	{
+		std::map<const swarm_block_header *, Pbuffer>::iterator i = blocks.find(b.hdr);
+		if(i != blocks.end())
+		{
+			// decompressed by another thread meanwhile
+			buf = i->second;
+		}
+		else
+		{
+			// forget the oldest blocks
+			while(!order.empty() && bytes + b.len > max_bytes)
+			{
+				bytes -= blocks[order.front()]->size();
+				blocks.erase(order.front());
+				order.pop_front();
+			}
+
+			blocks.insert(std::make_pair(b.hdr, buf));
+			order.push_back(b.hdr);
+			bytes += buf->size();
+		}
+	}
+	return buf;
+}
+
 //! Sort the raw outputs
 struct idx_t
 {
 	const char *ptr;	// pointer to this packet in memory
 	int len;		// length of this packet (including header and data)
+	double T;		// time and system of this packet
+	int sys;
 
-	void gethdr(double &T, int &sys) const
-	{
-		gpulog::logrecord lr(ptr);
-		get_Tsys(lr, T, sys);
-	}
-
+	//! Order by time and system, stable sorting keeps equal packets in file order
 	bool operator< (const idx_t &a) const
 	{
-		double Tt, Ta;
-		int syst, sysa;
-		this->gethdr(Tt, syst);
-		a.gethdr(Ta, sysa);
-
-		return 	 Tt < Ta || (
-				Tt == Ta && syst < sysa || (
-					syst == sysa && this->ptr < a.ptr
-				)
-			);
+		return T < a.T || (T == a.T && sys < a.sys);
 	}
 };
 
 ///
 struct index_entry_time_cmp
 {
-	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.T < b.T || (a.T == b.T && a.sys < b.sys || (a.sys == b.sys && a.offs < b.offs) ); }
+	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.T < b.T || (a.T == b.T && (a.sys < b.sys || (a.sys == b.sys && a.offs < b.offs))); }
 };
 
 ///
 struct index_entry_sys_cmp
 {
-	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.sys < b.sys || (a.sys == b.sys && a.T < b.T) || (a.T == b.T && a.offs < b.offs); }
+	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.sys < b.sys || (a.sys == b.sys && (a.T < b.T || (a.T == b.T && a.offs < b.offs))); }
 };
 
-#if 0
-struct index_entry_bod_cmp
+///
+struct index_entry_evt_cmp
 {
-  bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const       { return a.body < b.body || (a.sys == b.sys && a.body ==  b.body && a.T < b.T ) || (a.T == b.T && a.sys == b.sys && a.offs < b.offs); }
+	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.evt < b.evt || (a.evt == b.evt && index_entry_time_cmp()(a, b)); }
+};
+
+///
+struct index_entry_body_cmp
+{
+	bool operator()(const swarmdb::index_entry &a, const swarmdb::index_entry &b) const { return a.body < b.body || (a.body == b.body && index_entry_sys_cmp()(a, b)); }
 };
-#endif
 
 ///
 bool get_file_info(uint64_t &timestamp, uint64_t &filesize, const std::string &fn)
@@ -121,146 +244,651 @@ bool get_file_info(uint64_t &timestamp, uint64_t &filesize, const std::string &f
 	return true;
 }
 
-/// Define class for creating index
-template<typename Cmp>
-class index_creator : public index_creator_base
+//! Sort in parallel: the parts of the range are sorted by different threads and merged pairwise
+template<typename T, typename Cmp>
+static void parallel_sort(T *begin, T *end, Cmp cmp)
 {
-protected:
-	std::string suffix, filetype;
-	std::ofstream out;
-	std::string filename;
-	int nentries;
+	int nparts = 1;
+#ifdef _OPENMP
+	nparts = omp_get_max_threads();
+#endif
+	size_t n = end - begin;
+	if(nparts == 1 || n < 65536)
+	{
+		std::sort(begin, end, cmp);
+		return;
+	}
+
+	std::vector<size_t> bounds(nparts + 1);
+	for(int i = 0; i <= nparts; i++)
+	{
+		bounds[i] = n * i / nparts;
+	}
 
-//! Constructor
-public:
-	index_creator(const std::string &suffix_, const std::string &filetype_) : suffix(suffix_), filetype(filetype_), nentries(0) {}
+	#pragma omp parallel for
+	for(int i = 0; i < nparts; i++)
+	{
+		std::sort(begin + bounds[i], begin + bounds[i+1], cmp);
+	}
 
-        //!
-	virtual bool start(const std::string &datafile)
+	for(int width = 1; width < nparts; width *= 2)
 	{
-		filename = datafile + suffix;
-		out.open(filename.c_str());
-		assert(out);
+		#pragma omp parallel for
+		for(int i = 0; i < nparts; i += 2*width)
+		{
+			if(i + width < nparts)
+			{
+				std::inplace_merge(begin + bounds[i], begin + bounds[i + width], begin + bounds[std::min(i + 2*width, nparts)], cmp);
+			}
+		}
+	}
+}
 
-		//! get the timestamp and file size of the data file
-		uint64_t timestamp, filesize;
-		get_file_info(timestamp, filesize, datafile);
+//! Write the header of an index file and make room for nentries entries
+static void create_index_file(const std::string &filename, const std::string &filetype, const std::string &datafile, size_t nentries, uint64_t data_indexed, uint64_t fingerprint)
+{
+	//! get the timestamp and file size of the data file
+	uint64_t timestamp, filesize;
+	get_file_info(timestamp, filesize, datafile);
 
-		//! write header
-		swarm::swarm_index_header fh(filetype, timestamp, filesize);
-		out.write((char*)&fh, sizeof(fh));
-		return true;
+	std::ofstream out(filename.c_str());
+	swarm::swarm_index_header fh(filetype, timestamp, filesize, data_indexed, fingerprint);
+	out.write((char*)&fh, sizeof(fh));
+	if(nentries != 0)
+	{
+		out.seekp(sizeof(fh) + nentries*sizeof(swarmdb::index_entry) - 1);
+		out.put(0);
+	}
+	if(!out)
+	{
+		ERROR("Cannot write index file '" + filename + "'");
 	}
-        //!
-	virtual bool add_entry(uint64_t offs, gpulog::logrecord lr)
+}
+
+//! Records of the data file that are indexed by one thread
+struct index_piece
+{
+	int block;		// block of the records
+	uint64_t begin, end;	// byte range of the records in the block
+	size_t first, n;	// index entries of the records
+};
+
+//! Split the records past offset from into pieces of blocks or, in unframed
+//! files, of about piece_size bytes. Returns the end of the last complete record
+static uint64_t split_log_blocks(std::vector<index_piece> &pieces, size_t &nentries, const std::vector<log_block> &blocks, uint64_t from, uint64_t piece_size = 0)
+{
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+
+	// block headers already count their records
+	nentries = 0;
+	uint64_t data_indexed = from;
+	for(int b = 0; b != blocks.size(); b++)
 	{
-		swarmdb::index_entry ie;
-		ie.offs = offs;
-		get_Tsys(lr, ie.T, ie.sys);
-		out.write((const char *)&ie, sizeof(ie));
+		if(blocks[b].hdr != NULL)
+		{
+			if(blocks[b].offs < from) { continue; }
+
+			index_piece p = { b, 0, blocks[b].len, nentries, blocks[b].hdr->nrecords };
+			pieces.push_back(p);
+			nentries += p.n;
+			data_indexed = blocks[b].offs + blocks[b].len;
+			continue;
+		}
 
-		nentries++;
-		return true;
+		// walk the record headers, a record that is still being written ends the data
+		const uint64_t len = blocks[b].len;
+		uint64_t size = piece_size != 0 ? piece_size : std::max<uint64_t>((len - std::min(len, from)) / (4*nthreads), 1024*1024);
+		index_piece p = { b, from, from, nentries, 0 };
+		while(p.end + sizeof(gpulog::internal::header) <= len)
+		{
+			int reclen = gpulog::logrecord(blocks[b].begin + p.end).len();
+			if(reclen <= 0 || p.end + reclen > len) { break; }
+
+			p.end += reclen;
+			p.n++;
+			if(p.end - p.begin >= size)
+			{
+				pieces.push_back(p);
+				nentries += p.n;
+				index_piece next = { b, p.end, p.end, nentries, 0 };
+				p = next;
+			}
+		}
+		if(p.n != 0)
+		{
+			pieces.push_back(p);
+			nentries += p.n;
+		}
+		data_indexed = p.end;
 	}
+	return data_indexed;
+}
+
+//! Records of a block. Compressed blocks are decompressed into buf, the cache would serialize the threads
+static const char *block_records(const log_block &b, log::codec_t codec, std::vector<char> &buf)
+{
+	if(b.begin != NULL) { return b.begin; }
 
-        //!
-	virtual bool finish()
+	buf.resize(std::max<size_t>(b.len, 1));
+	log::decompress_block(codec, &buf[0], b.len, (const char *)&b.hdr[1], b.hdr->clen);
+	return &buf[0];
+}
+
+//! Event id of a record as it is read back, compact snapshots are expanded to EVT_SNAPSHOT
+static int record_evt(const gpulog::logrecord &lr)
+{
+	return lr.msgid() == EVT_SNAPSHOT_DELTA ? EVT_SNAPSHOT : lr.msgid();
+}
+
+//! Bodies a record is about: all bodies of a snapshot or the body of
+//! a body event. Returns the number of bodies, first is the first one
+static int get_bodies(gpulog::logrecord lr, int &first)
+{
+	double T;
+	int sys, flags, nbod;
+	body b;
+	switch(lr.msgid())
 	{
-		out.close();
+	case EVT_SNAPSHOT:
+	case EVT_SNAPSHOT_DELTA:
+		lr >> T >> sys >> flags >> nbod;
+		first = 0;
+		return nbod;
+	case EVT_EJECTION:
+		lr >> T >> sys >> b;
+		first = b.body_id;
+		return 1;
+	case EVT_RV_OBS:
+	case EVT_TRANSIT:
+	case EVT_OCCULTATION:
+		lr >> T >> sys >> first;
+		return 1;
+	}
+	return 0;
+}
 
-		// sort by time
-		mmapped_swarm_index_file mm(filename, filetype, MemoryMap::rw);
-		swarmdb::index_entry *begin = (swarmdb::index_entry *)mm.data(), *end = begin + mm.size()/sizeof(swarmdb::index_entry);
-		assert((end - begin) == nentries);
+//! Index the records of the pieces in parallel, returns false if a block has more or less records than its header says
+static bool index_pieces(const std::vector<index_piece> &pieces, const std::vector<log_block> &blocks, log::codec_t codec, swarmdb::index_entry *entries)
+{
+	bool ok = true;
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)pieces.size(); i++)
+	{
+		const index_piece &p = pieces[i];
+		const log_block &b = blocks[p.block];
+		std::vector<char> buf;
+		const char *begin;
+		try
+		{
+			begin = block_records(b, codec, buf);
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_index_pieces)
+			error = e.what();
+			continue;
+		}
 
-		std::sort(begin, end, Cmp());
-	#if 1
-		Cmp cmp;
-		for(int i=1; i < nentries; i++)
+		gpulog::ilogstream ils(begin + p.begin, p.end - p.begin);
+		gpulog::logrecord lr;
+		size_t e = p.first;
+		while((lr = ils.next()) && e != p.first + p.n)
+		{
+			swarmdb::index_entry &ie = entries[e++];
+			ie.offs = b.offs + (lr.ptr - begin);
+			ie.evt = record_evt(lr);
+			ie.body = -1;
+			get_Tsys(lr, ie.T, ie.sys);
+		}
+		if(e != p.first + p.n || lr)
 		{
-			bool ok = cmp(begin[i-1], begin[i]);		// they're less
-			if(!ok) { ok = !cmp(begin[i], begin[i-1]); }	// they're equal
-			assert(ok);
+			#pragma omp critical(swarm_index_pieces)
+			ok = false;
 		}
-	#endif
-		return true;
 	}
-};
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
+	return ok;
+}
 
-//!
-void swarmdb::index_binary_log_file(std::vector<boost::shared_ptr<index_creator_base> > &ic, const std::string &datafile)
+//! Merge new entries into an index, the merged index replaces the file
+template<typename Cmp>
+static void merge_into_index(const swarmdb::index_entry *begin, const swarmdb::index_entry *end, std::vector<swarmdb::index_entry> &entries,
+	const std::string &filename, const std::string &filetype, const std::string &datafile, uint64_t data_indexed, uint64_t fingerprint)
 {
-	// open datafile
-	gpulog::ilogstream ils(mmdata.data(), mmdata.size());
-	gpulog::logrecord lr;
+	if(!entries.empty())
+	{
+		parallel_sort(&entries[0], &entries[0] + entries.size(), Cmp());
+	}
+
+	// the old index stays mapped until it is replaced
+	std::string tmpfn = filename + ".tmp";
+	size_t nentries = (end - begin) + entries.size();
+	create_index_file(tmpfn, filetype, datafile, nentries, data_indexed, fingerprint);
+	{
+		mmapped_swarm_index_file mm(tmpfn, filetype, MemoryMap::rw);
+		std::merge(begin, end, entries.begin(), entries.end(), (swarmdb::index_entry *)mm.data(), Cmp());
+	}
+	if(rename(tmpfn.c_str(), filename.c_str()) != 0)
+	{
+		ERROR("Cannot write index file '" + filename + "'");
+	}
+}
 
-	// postprocess (this is where the creator may sort or store the index)
-	for(int i=0; i != ic.size(); i++)
+//! The indexes that are built from the records when the data file is opened
+enum { TIME_INDEX, SYS_INDEX, EVT_INDEX, NUM_RECORD_INDEXES };
+static const char *record_index_suffix[NUM_RECORD_INDEXES] = { ".time.idx", ".sys.idx", ".evt.idx" };
+static const char *record_index_filetype[NUM_RECORD_INDEXES] = { T_INDEX_CHECK, SYS_INDEX_CHECK, EVT_INDEX_CHECK };
+
+//! Sort the entries of an index of the given kind
+static void sort_record_index(int kind, swarmdb::index_entry *begin, swarmdb::index_entry *end)
+{
+	switch(kind)
+	{
+	case TIME_INDEX: parallel_sort(begin, end, index_entry_time_cmp()); break;
+	case SYS_INDEX:  parallel_sort(begin, end, index_entry_sys_cmp()); break;
+	case EVT_INDEX:  parallel_sort(begin, end, index_entry_evt_cmp()); break;
+	}
+}
+
+//! Merge new entries into an index of the given kind
+static void merge_record_index(int kind, const swarmdb::index_entry *begin, const swarmdb::index_entry *end, std::vector<swarmdb::index_entry> &entries,
+	const std::string &filename, const std::string &datafile, uint64_t data_indexed, uint64_t fingerprint)
+{
+	const char *filetype = record_index_filetype[kind];
+	switch(kind)
 	{
-		ic[i]->start(datafile);
+	case TIME_INDEX: merge_into_index<index_entry_time_cmp>(begin, end, entries, filename, filetype, datafile, data_indexed, fingerprint); break;
+	case SYS_INDEX:  merge_into_index<index_entry_sys_cmp>(begin, end, entries, filename, filetype, datafile, data_indexed, fingerprint); break;
+	case EVT_INDEX:  merge_into_index<index_entry_evt_cmp>(begin, end, entries, filename, filetype, datafile, data_indexed, fingerprint); break;
 	}
+}
 
-	// stream through the data file
-	while(lr = ils.next())
+/*!
+ * Build the time, system and/or event index in one pass over the data file.
+ *
+ * The records are split into pieces (blocks, or runs of records of an
+ * unframed file) that are indexed in parallel straight into the first
+ * index file. The other indexes are copies of the first; each is then
+ * sorted with a parallel merge sort.
+ *
+ * If from is not 0, the indexes cover the data up to from already. Only
+ * the records past from are indexed, sorted and merged into them.
+ */
+void swarmdb::build_indexes(bool time, bool sys, bool evt, uint64_t from) const
+{
+	std::vector<index_piece> pieces;
+	size_t nentries;
+	uint64_t data_indexed = split_log_blocks(pieces, nentries, blocks, from);
+	uint64_t fingerprint = data_fingerprint(data_indexed);
+
+	std::vector<int> kinds;
+	if(time) { kinds.push_back(TIME_INDEX); }
+	if(sys)  { kinds.push_back(SYS_INDEX); }
+	if(evt)  { kinds.push_back(EVT_INDEX); }
+	const index_handle *handles[NUM_RECORD_INDEXES] = { &idx_time, &idx_sys, &idx_evt };
+
+	log::codec_t codec = log::codec_t(mmdata.hdr().flags);
+	if(from != 0)
 	{
-		for(int i=0; i != ic.size(); i++)
+		// index the appended records and merge them into the indexes
+		std::vector<index_entry> entries(nentries);
+		if(nentries != 0 && !index_pieces(pieces, blocks, codec, &entries[0]))
+		{
+			ERROR("Record counts of the blocks in '" + datafile + "' do not match their headers");
+		}
+		for(int i = 0; i != kinds.size(); i++)
 		{
-			ic[i]->add_entry(lr.ptr - mmdata.data(), lr);
+			int k = kinds[i];
+			std::vector<index_entry> e(entries);
+			merge_record_index(k, handles[k]->begin, handles[k]->end, e, datafile + record_index_suffix[k], datafile, data_indexed, fingerprint);
 		}
+		return;
+	}
+
+	// fill the first index, the records are not necessarily in memory otherwise
+	int k = kinds[0];
+	std::string fn = datafile + record_index_suffix[k];
+	create_index_file(fn, record_index_filetype[k], datafile, nentries, data_indexed, fingerprint);
+	mmapped_swarm_index_file mm(fn, record_index_filetype[k], MemoryMap::rw);
+	index_entry *entries = (index_entry *)mm.data();
+	assert(mm.size()/sizeof(index_entry) == nentries);
+
+	if(!index_pieces(pieces, blocks, codec, entries))
+	{
+		ERROR("Record counts of the blocks in '" + datafile + "' do not match their headers");
 	}
 
-	// postprocess (this is where the creator may sort or store the index)
-	for(int i=0; i != ic.size(); i++)
+	// the other indexes start as copies
+	for(int i = 1; i < kinds.size(); i++)
 	{
-		ic[i]->finish();
+		int k = kinds[i];
+		std::string fn = datafile + record_index_suffix[k];
+		create_index_file(fn, record_index_filetype[k], datafile, nentries, data_indexed, fingerprint);
+		mmapped_swarm_index_file omm(fn, record_index_filetype[k], MemoryMap::rw);
+		std::copy(entries, entries + nentries, (index_entry *)omm.data());
+		sort_record_index(k, (index_entry *)omm.data(), (index_entry *)omm.data() + nentries);
 	}
+	sort_record_index(k, entries, entries + nentries);
 }
 
-/*
-	Implementation note: This implementation will probably barf
-	when log sizes reach a few GB. A better implementation, using merge
-	sort could/should be written.
-*/
+/*!
+ * Build the body index, with an entry for every body of every snapshot
+ * and for the body of every body event.
+ *
+ * If from is not 0, the index covers the data up to from already. Only
+ * the records past from are indexed and merged into it.
+ */
+void swarmdb::build_body_index(uint64_t from) const
+{
+	std::vector<index_piece> pieces;
+	size_t nrecords;
+	uint64_t data_indexed = split_log_blocks(pieces, nrecords, blocks, from);
+
+	// a record has any number of bodies, every piece collects its own entries
+	log::codec_t codec = log::codec_t(mmdata.hdr().flags);
+	std::vector<std::vector<index_entry> > parts(pieces.size());
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)pieces.size(); i++)
+	{
+		const index_piece &p = pieces[i];
+		const log_block &b = blocks[p.block];
+		std::vector<char> buf;
+		const char *begin;
+		try
+		{
+			begin = block_records(b, codec, buf);
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_body_index)
+			error = e.what();
+			continue;
+		}
+
+		gpulog::ilogstream ils(begin + p.begin, p.end - p.begin);
+		gpulog::logrecord lr;
+		while(lr = ils.next())
+		{
+			int first, nbod = get_bodies(lr, first);
+
+			index_entry ie;
+			ie.offs = b.offs + (lr.ptr - begin);
+			ie.evt = record_evt(lr);
+			get_Tsys(lr, ie.T, ie.sys);
+			for(ie.body = first; ie.body != first + nbod; ie.body++)
+			{
+				parts[i].push_back(ie);
+			}
+		}
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
 
-//! Sort the binary file
-bool sort_binary_log_file(const std::string &outfn, const std::string &infn)
+	std::vector<index_entry> entries;
+	for(int i = 0; i != parts.size(); i++)
+	{
+		entries.insert(entries.end(), parts[i].begin(), parts[i].end());
+	}
+
+	const index_entry *begin = NULL, *end = NULL;
+	if(from != 0)
+	{
+		begin = idx_body.begin;
+		end = idx_body.end;
+	}
+	merge_into_index<index_entry_body_cmp>(begin, end, entries, datafile + ".body.idx", BODY_INDEX_CHECK, datafile, data_indexed, data_fingerprint(data_indexed));
+}
+
+//! A piece of the log file that is sorted in memory
+struct sort_run
 {
-	mmapped_swarm_file mm(infn, UNSORTED_HEADER_CHECK);
-	gpulog::ilogstream ils(mm.data(), mm.size());
-	std::vector<idx_t> idx;
-	gpulog::logrecord lr;
+	int first_block, last_block;	// blocks of the run, [first, last)
+	uint64_t begin, end;		// byte range of the run in an unframed file, bytes of the blocks otherwise
+};
+
+//! Sorted records of a run file, read sequentially in large chunks
+struct sort_run_reader
+{
+	std::ifstream in;
+	std::vector<char> buf;
+	size_t at, len;
+	int run;
+	double T;
+	int sys;
+
+	//! Current record, NULL at the end of the run
+	const char *record() const { return at < len ? &buf[at] : NULL; }
+
+	//! Make sure the next record is in the buffer and read its heading
+	void fill()
+	{
+		size_t hlen = sizeof(gpulog::internal::header);
+		if(at + hlen > len || at + ((const gpulog::internal::header *)&buf[at])->len > len)
+		{
+			// move the partial record to the front and read more
+			std::copy(buf.begin() + at, buf.begin() + len, buf.begin());
+			len -= at; at = 0;
+			in.read(&buf[len], buf.size() - len);
+			len += in.gcount();
+			if(len < hlen) { len = 0; return; }
+		}
+
+		gpulog::logrecord lr(&buf[at]);
+		if(at + lr.len() > len)
+		{
+			ERROR("Truncated record in a sorted run");
+		}
+		get_Tsys(lr, T, sys);
+	}
+
+	void next()
+	{
+		at += gpulog::logrecord(&buf[at]).len();
+		fill();
+	}
+
+	//! The run with the smaller head comes out of the heap first, ties keep the order of the input
+	bool operator< (const sort_run_reader &a) const
+	{
+		return T > a.T || (T == a.T && (sys > a.sys || (sys == a.sys && run > a.run)));
+	}
+};
+
+//! Name of the temporary file of the i-th sorted run
+static std::string sort_run_filename(const std::string &prefix, int i)
+{
+	char suffix[32];
+	sprintf(suffix, "%d", i);
+	return prefix + suffix;
+}
 
-	// load record information
+//! Order run readers in a heap, see sort_run_reader::operator<
+static bool sort_run_reader_less(const sort_run_reader *a, const sort_run_reader *b)
+{
+	return *a < *b;
+}
+
+/*!
+ * Sort the binary file with an external merge sort.
+ *
+ * The file is split into runs of about max_memory/(2*threads) bytes that
+ * are sorted in parallel and written to temporary files in tmpdir (next
+ * to outfn if empty). The runs are then merged into outfn in one pass
+ * with buffered sequential reads and writes, so the memory used does not
+ * depend on the size of the log.
+ */
+bool sort_binary_log_file(const std::string &outfn, const std::string &infn, size_t max_memory, const std::string &tmpdir)
+{
+	mmapped_swarm_file mm;
+	std::vector<log_block> blocks;
+	log_file_format format = open_log_file(mm, infn);
+	get_log_blocks(blocks, mm, format);
+	log::codec_t codec = (log::codec_t)mm.hdr().flags;
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	uint64_t run_size = std::max<uint64_t>(max_memory / (2*nthreads), 1024*1024);
+
+	// split the file into runs: whole blocks, or pieces of the one block of an unframed file
+	std::vector<sort_run> runs;
 	uint64_t datalen = 0;
-	for(int i=0; lr = ils.next(); i++)
+	for(int b = 0; b != blocks.size(); b++)
+	{
+		datalen += blocks[b].len;
+		if(blocks[b].hdr == NULL)
+		{
+			gpulog::ilogstream ils(blocks[b].begin, blocks[b].len);
+			gpulog::logrecord lr;
+			sort_run r = { b, b + 1, 0, 0 };
+			while(lr = ils.next())
+			{
+				r.end = lr.ptr + lr.len() - blocks[b].begin;
+				if(r.end - r.begin >= run_size) { runs.push_back(r); r.begin = r.end; }
+			}
+			if(r.end != r.begin) { runs.push_back(r); }
+			continue;
+		}
+
+		if(runs.empty() || runs.back().end >= run_size)
+		{
+			sort_run r = { b, b, 0, 0 };
+			runs.push_back(r);
+		}
+		runs.back().last_block = b + 1;
+		runs.back().end += blocks[b].len;
+	}
+
+	std::string runfn = outfn;
+	if(!tmpdir.empty())
 	{
-		idx_t ii;
-		ii.ptr = lr.ptr;
-		ii.len = lr.len();
-		idx.push_back(ii);
+		size_t slash = outfn.rfind('/');
+		runfn = tmpdir + "/" + (slash == std::string::npos ? outfn : outfn.substr(slash + 1));
+	}
+	runfn += ".run.";
+
+	// sort the runs in parallel
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)runs.size(); i++)
+	{
+		const sort_run &r = runs[i];
+		std::vector<boost::shared_ptr<std::vector<char> > > buffers;
+		std::vector<idx_t> idx;
+		gpulog::logrecord lr;
+
+		try
+		{
+			for(int b = r.first_block; b != r.last_block; b++)
+			{
+				const char *begin = blocks[b].begin;
+				size_t len = blocks[b].len;
+				if(blocks[b].hdr == NULL)
+				{
+					begin += r.begin; len = r.end - r.begin;
+				}
+				else if(begin == NULL)
+				{
+					// decompressed blocks are only kept while the run is sorted
+					buffers.push_back(boost::shared_ptr<std::vector<char> >(new std::vector<char>(std::max<size_t>(len, 1))));
+					log::decompress_block(codec, &(*buffers.back())[0], len, (const char *)&blocks[b].hdr[1], blocks[b].hdr->clen);
+					begin = &(*buffers.back())[0];
+				}
+
+				gpulog::ilogstream ils(begin, len);
+				while(lr = ils.next())
+				{
+					idx_t ii;
+					ii.ptr = lr.ptr;
+					ii.len = lr.len();
+					get_Tsys(lr, ii.T, ii.sys);
+					idx.push_back(ii);
+				}
+			}
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_sort_runs)
+			error = e.what();
+			continue;
+		}
+
+		std::stable_sort(idx.begin(), idx.end());
 
-		datalen += ii.len;
+		std::ofstream out(sort_run_filename(runfn, i).c_str(), std::ios::binary);
+		for(int j = 0; j != idx.size(); j++)
+		{
+			out.write(idx[j].ptr, idx[j].len);
+		}
+		if(!out)
+		{
+			#pragma omp critical(swarm_sort_runs)
+			error = "Could not write '" + sort_run_filename(runfn, i) + "'";
+		}
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
 	}
-	assert(datalen == mm.size());
 
-	// sort
-	std::sort(idx.begin(), idx.end());
+	// merge the runs, every run and the output get an equal share of the memory
+	size_t chunk = std::max<size_t>(max_memory / (runs.size() + 1), 1024*1024);
+	std::vector<boost::shared_ptr<sort_run_reader> > readers;
+	std::vector<sort_run_reader *> heap;
+	for(int i = 0; i != runs.size(); i++)
+	{
+		readers.push_back(boost::shared_ptr<sort_run_reader>(new sort_run_reader()));
+		sort_run_reader &rr = *readers.back();
+		rr.in.open(sort_run_filename(runfn, i).c_str(), std::ios::binary);
+		rr.buf.resize(chunk);
+		rr.at = rr.len = 0;
+		rr.run = i;
+		rr.fill();
+		if(rr.record() != NULL) { heap.push_back(&rr); }
+	}
+	std::make_heap(heap.begin(), heap.end(), sort_run_reader_less);
 
-	// output file header
-	std::ofstream out(outfn.c_str());
+	std::vector<char> outbuf(chunk);
+	std::ofstream out;
+	out.rdbuf()->pubsetbuf(&outbuf[0], outbuf.size());
+	out.open(outfn.c_str(), std::ios::binary);
 	swarm_header fh(SORTED_HEADER_FULL, 0, datalen);
 	out.write((char*)&fh, sizeof(fh));
 
-	// write out the data
-	for(int i = 0; i != idx.size(); i++)
+	while(!heap.empty())
 	{
-		out.write(idx[i].ptr, idx[i].len);
+		std::pop_heap(heap.begin(), heap.end(), sort_run_reader_less);
+		sort_run_reader &rr = *heap.back();
+		out.write(rr.record(), gpulog::logrecord(rr.record()).len());
+
+		rr.next();
+		if(rr.record() != NULL)
+			std::push_heap(heap.begin(), heap.end(), sort_run_reader_less);
+		else
+			heap.pop_back();
 	}
 	size_t tp = out.tellp();
 	assert(tp == sizeof(fh) + datalen);
 	out.close();
 
-	return true;
+	for(int i = 0; i != runs.size(); i++)
+	{
+		readers[i]->in.close();
+		remove(sort_run_filename(runfn, i).c_str());
+	}
+
+	return tp == sizeof(fh) + datalen;
 }
 
 //! Define structure sysinfo 
@@ -268,7 +896,7 @@ struct sysinfo
 {
 	int sys;
 	long flags;
-	const body *bodies;
+	std::vector<body> bodies;
 
 	bool operator <(const sysinfo &a) const
 	{
@@ -289,8 +917,9 @@ bool swarmdb::snapshots::next(cpu_ensemble &ens)
 		if(lr.msgid() != log::EVT_SNAPSHOT) { continue; }
 
 		// get time & system ID
-		double T; int nbod_tmp; sysinfo si;
-		lr >> T >> si.sys >> si.flags >> nbod_tmp;
+		double T; int nbod_tmp, flags; sysinfo si;
+		lr >> T >> si.sys >> flags >> nbod_tmp;
+		si.flags = flags;
 		if(nbod == -1)
 		{
 			Tsnapend = T*(1+Trelerr) + Tabserr;
@@ -311,8 +940,10 @@ bool swarmdb::snapshots::next(cpu_ensemble &ens)
 			continue;
 		}
 
-		// load the pointer to bodies
-		lr >> si.bodies;
+		// copy the bodies, the record does not necessarily stay in memory
+		const body *bodies;
+		lr >> bodies;
+		si.bodies.assign(bodies, bodies + nbod);
 		systems.insert(si);
 
 		sysmax = std::max(si.sys, sysmax);
@@ -356,72 +987,307 @@ swarmdb::snapshots::snapshots(const swarmdb &db_, time_range_t T, double Tabserr
 {
 }
 
+//! Order index entries by system and time only
+static bool index_entry_sys_T_less(const swarmdb::index_entry &a, const swarmdb::index_entry &b)
+{
+	return a.sys < b.sys || (a.sys == b.sys && a.T < b.T);
+}
+
+//! Order the ranges of a query result by their next entry, for a heap with the earliest on top
+struct range_after
+{
+	const std::vector<swarmdb::result::index_range> &ranges;
+	range_after(const std::vector<swarmdb::result::index_range> &ranges_) : ranges(ranges_) {}
+	bool operator()(int a, int b) const { return index_entry_time_cmp()(*ranges[b].first, *ranges[a].first); }
+};
+
 //!
 swarmdb::result::result(const swarmdb &db_, const sys_range_t &sys_, const time_range_t &T_)
-  : db(db_), sys(sys_), T(T_)
+  : db(db_), sys(sys_), T(T_), bod(-1), prevrange(-1), zone(-1)
 {
 	using namespace boost;
 
-	if(sys.first == sys.last || !T)
-	{
-		// find the sys index range
-		swarmdb::index_entry dummy;
-		dummy.sys = sys.first; begin = std::lower_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
-		dummy.sys = sys.last;  end   = std::upper_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
-	}
-	else if(T)
+	// no zone holds matching records, the indexes are not needed
+	if(!db.may_contain(sys, T))
 	{
-		// find the first T in the range
-		swarmdb::index_entry dummy;
-		dummy.T = T.first; begin = std::lower_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
-		dummy.T = T.last;  end   = std::upper_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
+		begin = end = at = atprev = NULL;
+		return;
 	}
-	else
+	db.require_indexes();
+
+	// find the sys index range
+	swarmdb::index_entry dummy;
+	dummy.sys = sys.first; const index_entry *sbegin = std::lower_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
+	dummy.sys = sys.last;  const index_entry *send   = std::upper_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
+	if(!T)
 	{
-		// stream through everything, time first
-		begin = db.idx_time.begin;
-		end   = db.idx_time.end;
+		begin = sbegin;
+		end   = send;
+		at = atprev = begin;
+		return;
 	}
 
-	at = begin;
-	atprev = at;
-}
+	// find the first T in the range
+	dummy.T = T.first; begin = std::lower_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
+	dummy.T = T.last;  end   = std::upper_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
+	at = atprev = begin;
 
+	// the sys index is sorted by system and time, so the records of a system
+	// in the time window are one range of it. Looking up the range of every
+	// system in the query beats filtering the time window if that is larger
+	double nsys = std::min<double>(send - sbegin, double(sys.last) - sys.first + 1);
+	if(end - begin <= 3 * nsys * log2(double(send - sbegin) + 2)) { return; }
 
-#if 0
-swarmdb::result::result(const swarmdb &db_, const sys_range_t &sys_, const body_range_t &body_, const time_range_t &T_)	  : db(db_), sys(sys_), body(body_), T(T_)
-{
-	using namespace boost;
+	db.system_ranges(ranges, sys, T);
 
-	if(sys.first == sys.last || !T)
-	{
-		// find the sys index range
-		swarmdb::index_entry dummy;
-		dummy.sys = sys.first; begin = std::lower_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
-		dummy.sys = sys.last;  end   = std::upper_bound(db.idx_sys.begin, db.idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
-	}
-	else if(T)
+	// one range is read like the others, more are merged by time
+	begin = end = at = atprev = NULL;
+	if(ranges.size() == 1)
 	{
-		// find the first T in the range
-		swarmdb::index_entry dummy;
-		dummy.T = T.first; begin = std::lower_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
-		dummy.T = T.last;  end   = std::upper_bound(db.idx_time.begin, db.idx_time.end, dummy, bind( &index_entry::T, _1 ) < bind( &index_entry::T, _2 ));
+		begin = at = atprev = ranges[0].first;
+		end = ranges[0].second;
+		ranges.clear();
 	}
-	else
+	for(int i = 0; i != ranges.size(); i++)
 	{
-		// stream through everything, time first
-		begin = db.idx_time.begin;
-		end   = db.idx_time.end;
+		heap.push_back(i);
 	}
-
-	at = begin;
-	atprev = at;
+	std::make_heap(heap.begin(), heap.end(), range_after(ranges));
 }
-#endif
 
-//! Return next log record
-gpulog::logrecord swarmdb::result::next()
+
+//! Ranges of the sys index with the records of each system in the time window
+void swarmdb::system_ranges(std::vector<result::index_range> &ranges, sys_range_t sys, time_range_t T) const
 {
+	using namespace boost;
+
+	ranges.clear();
+	if(!may_contain(sys, T)) { return; }
+	require_indexes();
+
+	swarmdb::index_entry dummy;
+	dummy.sys = sys.first; const index_entry *sbegin = std::lower_bound(idx_sys.begin, idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
+	dummy.sys = sys.last;  const index_entry *send   = std::upper_bound(idx_sys.begin, idx_sys.end, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
+
+	for(const index_entry *p = sbegin; p != send; )
+	{
+		dummy.sys = p->sys;
+		const index_entry *next = std::upper_bound(p, send, dummy, bind( &index_entry::sys, _1 ) < bind( &index_entry::sys, _2 ));
+		dummy.T = T.first; const index_entry *rbegin = std::lower_bound(p, next, dummy, index_entry_sys_T_less);
+		dummy.T = T.last;  const index_entry *rend   = std::upper_bound(rbegin, next, dummy, index_entry_sys_T_less);
+		if(rbegin != rend)
+		{
+			ranges.push_back(result::index_range(rbegin, rend));
+		}
+		p = next;
+	}
+}
+
+//! Order index entries by event id and time
+static bool index_entry_evt_key_less(const swarmdb::index_entry &a, const swarmdb::index_entry &b)
+{
+	return a.evt < b.evt || (a.evt == b.evt && a.T < b.T);
+}
+
+//!
+swarmdb::result::result(const swarmdb &db_, const sys_range_t &sys_, const time_range_t &T_, const evt_range_t &evt_)
+  : db(db_), sys(sys_), T(T_), evt(evt_), bod(-1), prevrange(-1), zone(-1)
+{
+	db.require_indexes();
+
+	// the event index is sorted by event id and time; the
+	// range is narrowed by the time of a single event id
+	swarmdb::index_entry lo, hi;
+	lo.evt = evt.first;
+	hi.evt = evt.last;
+	lo.T = evt.first == evt.last ? T.first : double(MIN);
+	hi.T = evt.first == evt.last ? T.last  : double(MAX);
+	begin = std::lower_bound(db.idx_evt.begin, db.idx_evt.end, lo, index_entry_evt_key_less);
+	end   = std::upper_bound(db.idx_evt.begin, db.idx_evt.end, hi, index_entry_evt_key_less);
+
+	at = begin;
+	atprev = at;
+}
+
+//! Order index entries by event id only
+static bool index_entry_evt_less(const swarmdb::index_entry &a, const swarmdb::index_entry &b)
+{
+	return a.evt < b.evt;
+}
+
+//! Ranges of the event index with the records of each event id in the time window
+void swarmdb::event_ranges(std::vector<result::index_range> &ranges, evt_range_t evt, time_range_t T) const
+{
+	ranges.clear();
+	require_indexes();
+
+	swarmdb::index_entry dummy;
+	dummy.evt = evt.first;
+	for(const index_entry *p = std::lower_bound(idx_evt.begin, idx_evt.end, dummy, index_entry_evt_less); p != idx_evt.end && p->evt <= evt.last; )
+	{
+		const index_entry *next = std::upper_bound(p, idx_evt.end, *p, index_entry_evt_less);
+		dummy.evt = p->evt;
+		dummy.T = T.first; const index_entry *rbegin = std::lower_bound(p, next, dummy, index_entry_evt_key_less);
+		dummy.T = T.last;  const index_entry *rend   = std::upper_bound(rbegin, next, dummy, index_entry_evt_key_less);
+		if(rbegin != rend)
+		{
+			ranges.push_back(result::index_range(rbegin, rend));
+		}
+		p = next;
+	}
+}
+
+//! Add the records of a time-ordered index range to a count
+static void add_count(swarmdb::count_t &c, const swarmdb::index_entry *begin, const swarmdb::index_entry *end)
+{
+	if(begin == end) { return; }
+	c.Tmin = c.n == 0 ? begin->T : std::min(c.Tmin, begin->T);
+	c.Tmax = c.n == 0 ? end[-1].T : std::max(c.Tmax, end[-1].T);
+	c.n += end - begin;
+}
+
+//! Count the records of systems sys, from the zone map if possible
+swarmdb::count_t swarmdb::count(sys_range_t sys, time_range_t T, evt_range_t evt) const
+{
+	count_t c = { -1, 0, std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN() };
+
+	// system-defined records have system -1
+	sys.first = std::max(sys.first, 0);
+	if(!sys || !T || !evt || !may_contain(sys, T)) { return c; }
+
+	// zones that lie within the ranges are counted as they are
+	bool all_evt = evt.first == int(MIN) && evt.last == int(MAX);
+	bool zones_only = all_evt;
+	for(int z = 0; z != zones.size() && zones_only; z++)
+	{
+		const log_zone &lz = zones[z];
+		if(!lz.overlaps(sys, T)) { continue; }
+		if(sys.first <= lz.sysmin && lz.sysmax <= sys.last && T.first <= lz.Tmin && lz.Tmax <= T.last)
+		{
+			c.Tmin = c.n == 0 ? lz.Tmin : std::min(c.Tmin, lz.Tmin);
+			c.Tmax = c.n == 0 ? lz.Tmax : std::max(c.Tmax, lz.Tmax);
+			c.n += lz.nrecords;
+		}
+		else
+		{
+			zones_only = false;
+		}
+	}
+	if(zones_only) { return c; }
+	c.n = 0;
+
+	// the event index has the records of every event id in time order, they
+	// only have to be looked at one by one for a part of the systems
+	if(!all_evt)
+	{
+		std::vector<result::index_range> ranges;
+		event_ranges(ranges, evt, T);
+		for(int i = 0; i != ranges.size(); i++)
+		{
+			if(sys.first == 0 && sys.last == int(MAX) && ranges[i].first->evt >= 0)
+			{
+				add_count(c, ranges[i].first, ranges[i].second);
+				continue;
+			}
+			for(const index_entry *e = ranges[i].first; e != ranges[i].second; e++)
+			{
+				if(sys.in(e->sys)) { add_count(c, e, e + 1); }
+			}
+		}
+		return c;
+	}
+
+	std::vector<count_t> counts;
+	count_systems(counts, sys, T, evt);
+	for(int i = 0; i != counts.size(); i++)
+	{
+		c.Tmin = c.n == 0 ? counts[i].Tmin : std::min(c.Tmin, counts[i].Tmin);
+		c.Tmax = c.n == 0 ? counts[i].Tmax : std::max(c.Tmax, counts[i].Tmax);
+		c.n += counts[i].n;
+	}
+	return c;
+}
+
+//! Count the records of every system in the system or event index
+void swarmdb::count_systems(std::vector<count_t> &counts, sys_range_t sys, time_range_t T, evt_range_t evt) const
+{
+	counts.clear();
+	sys.first = std::max(sys.first, 0);
+	if(!sys || !T || !evt || !may_contain(sys, T)) { return; }
+
+	// the records of a system in the time window are one range of the sys index
+	if(evt.first == int(MIN) && evt.last == int(MAX))
+	{
+		std::vector<result::index_range> ranges;
+		system_ranges(ranges, sys, T);
+		for(int i = 0; i != ranges.size(); i++)
+		{
+			count_t c = { ranges[i].first->sys, 0, 0, 0 };
+			add_count(c, ranges[i].first, ranges[i].second);
+			counts.push_back(c);
+		}
+		return;
+	}
+
+	std::map<int, count_t> bysys;
+	std::vector<result::index_range> ranges;
+	event_ranges(ranges, evt, T);
+	for(int i = 0; i != ranges.size(); i++)
+	{
+		for(const index_entry *e = ranges[i].first; e != ranges[i].second; e++)
+		{
+			if(!sys.in(e->sys)) { continue; }
+			count_t &c = bysys[e->sys];
+			c.sys = e->sys;
+			add_count(c, e, e + 1);
+		}
+	}
+	for(std::map<int, count_t>::const_iterator i = bysys.begin(); i != bysys.end(); i++)
+	{
+		counts.push_back(i->second);
+	}
+}
+
+//! Order index entries by body, system and time
+static bool index_entry_body_key_less(const swarmdb::index_entry &a, const swarmdb::index_entry &b)
+{
+	return a.body < b.body || (a.body == b.body && (a.sys < b.sys || (a.sys == b.sys && a.T < b.T)));
+}
+
+//!
+swarmdb::result::result(const swarmdb &db_, const sys_range_t &sys_, const body_range_t &body_, const time_range_t &T_)
+  : db(db_), sys(sys_), body(body_), T(T_), bod(-1), prevrange(-1), zone(-1)
+{
+	db.open_body_index();
+
+	// the body index is sorted by body, system and time; the range is
+	// narrowed by the system and time of a single body and system
+	swarmdb::index_entry lo, hi;
+	lo.body = body.first;
+	hi.body = body.last;
+	lo.sys = body.first == body.last ? sys.first : int(MIN);
+	hi.sys = body.first == body.last ? sys.last  : int(MAX);
+	lo.T = body.first == body.last && sys.first == sys.last ? T.first : double(MIN);
+	hi.T = body.first == body.last && sys.first == sys.last ? T.last  : double(MAX);
+	begin = std::lower_bound(db.idx_body.begin, db.idx_body.end, lo, index_entry_body_key_less);
+	end   = std::upper_bound(db.idx_body.begin, db.idx_body.end, hi, index_entry_body_key_less);
+
+	at = begin;
+	atprev = at;
+}
+
+//! Return next log record
+gpulog::logrecord swarmdb::result::next()
+{
+	if(zone != -1)
+	{
+		return next_scanned();
+	}
+	if(!ranges.empty())
+	{
+		return next_merged();
+	}
+
 	if(at < end)
 	{
 		atprev = at;
@@ -431,9 +1297,103 @@ gpulog::logrecord swarmdb::result::next()
 	{
 		if(!T.in(at->T))       { at++; continue; }
 		if(!sys.in(at->sys))   { at++; continue; }
-		//			if(!body.in(at->body)) { at++; continue; }
+		if(!body.in(at->body)) { at++; continue; }
+		if(!evt.in(at->evt))   { at++; continue; }
+
+		bod = at->body;
+		return gpulog::logrecord(db.get_record(*(at++), hold));
+	}
+
+	static gpulog::header hend(-1, 0);
+	static gpulog::logrecord eof((char *)&hend);
+	return eof;
+}
+
+//!
+swarmdb::result::result(const swarmdb &db_, const sys_range_t &sys_, const time_range_t &T_, in_log_order, uint64_t from)
+  : db(db_), sys(sys_), T(T_), begin(NULL), end(NULL), at(NULL), atprev(NULL), bod(-1), prevrange(-1), zoneprev(-1)
+{
+	// start in the zone that holds offset from
+	int z = 0;
+	while(z < db.zones.size() && db.zone_end(z) <= from) { z++; }
+	load_zone(z);
+
+	// skip the records of the zone before from (the first block of a
+	// block-framed file starts after the file and block headers)
+	if(zone == z && zone < db.zones.size())
+	{
+		uint64_t offs = db.blocks[db.zones[zone].block].offs;
+		if(from > offs) { zat = std::max(zat, from - offs); }
+	}
+}
+
+//! Move a query in log order to the first zone from z on that may hold matching records
+void swarmdb::result::load_zone(int z)
+{
+	while(z < db.zones.size() && !db.zones[z].overlaps(sys, T)) { z++; }
+
+	zone = z;
+	zdata = NULL;
+	zat = zend = 0;
+	if(z == db.zones.size()) { return; }
+
+	const log_zone &lz = db.zones[z];
+	zdata = db.block_data(db.blocks[lz.block], zhold);
+	zat = lz.begin;
+	zend = lz.end;
+}
+
+//! Return the next log record of the zones, in log order
+gpulog::logrecord swarmdb::result::next_scanned()
+{
+	while(zone < (int)db.zones.size())
+	{
+		if(zat >= zend)
+		{
+			load_zone(zone + 1);
+			continue;
+		}
+
+		gpulog::logrecord lr(zdata + zat), l = lr;
+		index_entry ie;
+		ie.offs = db.blocks[db.zones[zone].block].offs + zat;
+		ie.evt = record_evt(lr);
+		ie.body = -1;
+		get_Tsys(l, ie.T, ie.sys);
+
+		zatprev = zat;
+		zat += lr.len();
+		if(!T.in(ie.T) || !sys.in(ie.sys) || !evt.in(ie.evt)) { continue; }
+
+		zoneprev = zone;
+		return gpulog::logrecord(lr.msgid() == EVT_SNAPSHOT_DELTA ? db.get_record(ie, hold) : lr.ptr);
+	}
+
+	static gpulog::header hend(-1, 0);
+	static gpulog::logrecord eof((char *)&hend);
+	return eof;
+}
 
-		return gpulog::logrecord(db.mmdata.data() + (at++)->offs);
+//! Return the next log record of the ranges, earliest first
+gpulog::logrecord swarmdb::result::next_merged()
+{
+	while(!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), range_after(ranges));
+		prevrange = heap.back();
+		index_range &r = ranges[prevrange];
+		atprev = r.first++;
+		if(r.first != r.second)
+		{
+			std::push_heap(heap.begin(), heap.end(), range_after(ranges));
+		}
+		else
+		{
+			heap.pop_back();
+		}
+
+		if(!evt.in(atprev->evt)) { continue; }
+		return gpulog::logrecord(db.get_record(*atprev, hold));
 	}
 
 	static gpulog::header hend(-1, 0);
@@ -443,15 +1403,261 @@ gpulog::logrecord swarmdb::result::next()
 
 void swarmdb::result::unget()
 {
-	at = atprev;
+	if(zone != -1)
+	{
+		if(zoneprev == -1) { return; }
+		if(zoneprev != zone) { load_zone(zoneprev); }
+		zat = zatprev;
+		zoneprev = -1;
+		return;
+	}
+
+	if(ranges.empty())
+	{
+		at = atprev;
+		return;
+	}
+
+	// put the last entry back into its range
+	if(prevrange == -1) { return; }
+	index_range &r = ranges[prevrange];
+	if(r.first == r.second)
+	{
+		heap.push_back(prevrange);
+	}
+	r.first = atprev;
+	std::make_heap(heap.begin(), heap.end(), range_after(ranges));
+	prevrange = -1;
 }
 
 //! Constructor for swarmdb
-swarmdb::swarmdb(const std::string &datafile)
+swarmdb::swarmdb(const std::string &datafile) : indexed(false), reindexed(false), body_indexed(false), decoded_bytes(0)
 {
 	open(datafile);
 }
 
+//! Order blocks by the offset of their first record
+static bool log_block_offs_less(uint64_t offs, const log_block &b)
+{
+	return offs < b.offs;
+}
+
+//! Find the record at offset offs of the (uncompressed) data
+const char *swarmdb::record(uint64_t offs, Pbuffer &hold) const
+{
+	if(!segments.empty())
+	{
+		size_t i = std::upper_bound(segment_offs.begin(), segment_offs.end(), offs) - segment_offs.begin() - 1;
+		return segments[i]->record(offs - segment_offs[i], hold);
+	}
+
+	if(format != LOG_COMPRESSED)
+	{
+		return mmdata.data() + offs;
+	}
+
+	std::vector<log_block>::const_iterator b = std::upper_bound(blocks.begin(), blocks.end(), offs, log_block_offs_less) - 1;
+	return block_data(*b, hold) + (offs - b->offs);
+}
+
+//! Find the last snapshot of system sys at time T stored before offset before
+const swarmdb::index_entry *swarmdb::find_snapshot(int sys, double T, uint64_t before) const
+{
+	require_indexes();
+
+	index_entry dummy;
+	dummy.sys = sys; dummy.T = T;
+	std::pair<const index_entry *, const index_entry *> r = std::equal_range(idx_sys.begin, idx_sys.end, dummy, index_entry_sys_T_less);
+
+	while(r.second != r.first)
+	{
+		const index_entry *e = --r.second;
+		// the index lists compact snapshots as EVT_SNAPSHOT
+		if(e->offs < before && e->evt == EVT_SNAPSHOT) { return e; }
+	}
+	return NULL;
+}
+
+//! Order index entries by system only
+static bool index_entry_sys_less(const swarmdb::index_entry &a, const swarmdb::index_entry &b)
+{
+	return a.sys < b.sys;
+}
+
+//! Order index entries by their offset in the data
+static bool index_entry_offs_less(const swarmdb::index_entry *a, const swarmdb::index_entry *b)
+{
+	return a->offs < b->offs;
+}
+
+//! Assemble the last snapshot of every system at or before time T
+bool swarmdb::snapshot_at(cpu_ensemble &ens, double T) const
+{
+	require_indexes();
+
+	// jump from system to system in the sys index and take the
+	// last snapshot at or before T of each one
+	std::vector<const index_entry *> found;
+	for(const index_entry *begin = idx_sys.begin; begin != idx_sys.end; )
+	{
+		const index_entry *end = std::upper_bound(begin, idx_sys.end, *begin, index_entry_sys_less);
+
+		index_entry key = *begin;
+		key.T = T;
+		for(const index_entry *e = std::upper_bound(begin, end, key, index_entry_sys_T_less); e != begin; )
+		{
+			if((--e)->evt == EVT_SNAPSHOT) { found.push_back(e); break; }
+		}
+
+		begin = end;
+	}
+	if(found.empty()) { return false; }
+
+	// all systems must have the same number of planets
+	int nbod;
+	{
+		double Tsnap; int sys, flags;
+		Pbuffer hold;
+		gpulog::logrecord lr(get_record(*found[0], hold));
+		lr >> Tsnap >> sys >> flags >> nbod;
+	}
+
+	ens = cpu_ensemble::create(nbod, found.back()->sys + 1);
+	for(int sys = 0; sys != ens.nsys(); sys++)
+	{
+		ens.set_inactive(sys);
+	}
+
+	// read the records in the order they are stored, so each thread works
+	// on a few neighbouring blocks that stay in the block cache
+	std::sort(found.begin(), found.end(), index_entry_offs_less);
+
+	std::string error;
+	#pragma omp parallel for
+	for(int i = 0; i < (int)found.size(); i++)
+	{
+		double Tsnap; int sys, flags, nbod_tmp;
+		const body *bodies;
+		Pbuffer hold;
+		try
+		{
+			gpulog::logrecord lr(get_record(*found[i], hold));
+			lr >> Tsnap >> sys >> flags >> nbod_tmp;
+			if(nbod_tmp != nbod)
+			{
+				ERROR("Snapshots with different numbers of bodies in '" + datafile + "'");
+			}
+			lr >> bodies;
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_snapshot_at)
+			error = e.what();
+			continue;
+		}
+
+		for(int bod = 0; bod != nbod; bod++)
+		{
+			const body &b = bodies[bod];
+			ens.set_body(sys, bod, b.mass, b.x, b.y, b.z, b.vx, b.vy, b.vz);
+		}
+		ens.flags(sys) = flags;
+		ens.time(sys) = Tsnap;
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
+
+	return true;
+}
+
+//! Expand a compact snapshot, decoding the compact snapshots it depends on first
+swarmdb::Pbuffer swarmdb::decode_snapshot(const index_entry &ie) const
+{
+	// walk back to a keyframe or to a snapshot that has already been expanded
+	std::vector<const index_entry *> chain;
+	const index_entry *e = &ie;
+	Pbuffer ref;
+	while(true)
+	{
+		#pragma omp critical(swarm_snapshot_cache)
+		{
+			std::map<uint64_t, Pbuffer>::const_iterator i = decoded.find(e->offs);
+			if(i != decoded.end()) { ref = i->second; }
+		}
+		if(ref) { break; }
+
+		Pbuffer hold;
+		gpulog::logrecord lr(record(e->offs, hold));
+		if(lr.msgid() != EVT_SNAPSHOT_DELTA)
+		{
+			ref.reset(new std::vector<char>(lr.ptr, lr.ptr + lr.len()));
+			break;
+		}
+
+		chain.push_back(e);
+		e = find_snapshot(e->sys, snapshot_reference_time(lr), e->offs);
+		if(e == NULL)
+		{
+			ERROR("Compact snapshot without a keyframe in '" + datafile + "'");
+		}
+	}
+
+	// expand the chain front to back
+	for(int i = chain.size() - 1; i >= 0; i--)
+	{
+		Pbuffer buf(new std::vector<char>()), hold;
+		if(!log::decode_snapshot(*buf, gpulog::logrecord(record(chain[i]->offs, hold)), gpulog::logrecord(&(*ref)[0])))
+		{
+			ERROR("Corrupted compact snapshot in '" + datafile + "'");
+		}
+		ref = buf;
+
+		#pragma omp critical(swarm_snapshot_cache)
+		{
+			// forget the oldest snapshots
+			while(!decoded_order.empty() && decoded_bytes + buf->size() > 64*1024*1024)
+			{
+				decoded_bytes -= decoded[decoded_order.front()]->size();
+				decoded.erase(decoded_order.front());
+				decoded_order.pop_front();
+			}
+
+			if(decoded.insert(std::make_pair(chain[i]->offs, buf)).second)
+			{
+				decoded_order.push_back(chain[i]->offs);
+				decoded_bytes += buf->size();
+			}
+		}
+	}
+
+	return ref;
+}
+
+//! Get the record of an index entry, expanding compact snapshots
+const char *swarmdb::get_record(const index_entry &ie, Pbuffer &hold) const
+{
+	// compact snapshots are expanded by their segment
+	if(!segments.empty())
+	{
+		size_t i = std::upper_bound(segment_offs.begin(), segment_offs.end(), ie.offs) - segment_offs.begin() - 1;
+		index_entry e = ie;
+		e.offs -= segment_offs[i];
+		return segments[i]->get_record(e, hold);
+	}
+
+	const char *ptr = record(ie.offs, hold);
+	if(gpulog::logrecord(ptr).msgid() != EVT_SNAPSHOT_DELTA)
+	{
+		return ptr;
+	}
+
+	// the cache may forget the expanded record, hold keeps it
+	hold = decode_snapshot(ie);
+	return &(*hold)[0];
+}
+
 //! Open output file
 void swarmdb::open(const std::string &datafile)
 {
@@ -461,77 +1667,530 @@ void swarmdb::open(const std::string &datafile)
 	}
 	this->datafile = datafile;
 
+	// open the segments of a segmented log
+	std::vector<std::string> files;
+	if(log::read_log_manifest(files, datafile))
+	{
+		open_segments(files);
+		open_zones();
+		return;
+	}
+
 	// open the datafile
-	mmdata.open(datafile, UNSORTED_HEADER_CHECK);
+	format = open_log_file(mmdata, datafile);
+	get_log_blocks(blocks, mmdata, format);
+	if(format == LOG_COMPRESSED)
+	{
+		cache = block_cache((log::codec_t)mmdata.hdr().flags);
+	}
+
+	// the indexes are opened by the first query that needs them
+	open_zones();
+}
 
-	// open the indexes
-	open_indexes();
+//! Whether any zone may hold records of systems sys in the time range T
+bool swarmdb::may_contain(const sys_range_t &sys, const time_range_t &T) const
+{
+	for(int i = 0; i != zones.size(); i++)
+	{
+		if(zones[i].overlaps(sys, T)) { return true; }
+	}
+	return false;
+}
+
+//! Open the zone map, building it if needed
+void swarmdb::open_zones()
+{
+	// a segmented log has the zones of its segments, with their blocks renumbered
+	if(!segments.empty())
+	{
+		int nblocks = 0;
+		for(int i = 0; i != segments.size(); i++)
+		{
+			for(int z = 0; z != segments[i]->zones.size(); z++)
+			{
+				log_zone lz = segments[i]->zones[z];
+				lz.block += nblocks;
+				zones.push_back(lz);
+			}
+			nblocks += segments[i]->blocks.size();
+		}
+		return;
+	}
+
+	// the zones of block-framed files are their blocks
+	if(format != LOG_UNFRAMED)
+	{
+		for(int b = 0; b != blocks.size(); b++)
+		{
+			const swarm_block_header &h = *blocks[b].hdr;
+			log_zone lz = { b, h.nrecords, 0, blocks[b].len, h.Tmin, h.Tmax, h.sysmin, h.sysmax };
+			zones.push_back(lz);
+		}
+		return;
+	}
+
+	// the zone map of an unframed file is cached on disk like the indexes
+	std::string filename = datafile + ".zone.idx";
+	uint64_t timestamp, filesize;
+	get_file_info(timestamp, filesize, datafile);
+
+	uint64_t from = 0;
+	swarm_index_header fh(""), zh(ZONE_INDEX_CHECK);
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if(in.read((char*)&fh, sizeof(fh)) && zh.is_compatible(fh))
+	{
+		// the zone map of a file that was written again is rebuilt
+		bool same = fh.data_indexed <= data_size() && fh.data_fingerprint == data_fingerprint(fh.data_indexed);
+		if(same && (fh.datafile_size == filesize || (fh.datafile_size < filesize && fh.data_indexed != 0)))
+		{
+			log_zone lz;
+			while(in.read((char*)&lz, sizeof(lz))) { zones.push_back(lz); }
+			if(fh.datafile_size == filesize) { return; }
+			from = fh.data_indexed;
+		}
+		else
+		{
+			std::cerr << "Index " << filename << " not up to date. Will regenerate.\n";
+		}
+	}
+	in.close();
+
+	uint64_t data_indexed = build_zones(zones, from);
+
+	std::string tmpfn = filename + ".tmp";
+	std::ofstream out(tmpfn.c_str(), std::ios::binary);
+	swarm_index_header nh(ZONE_INDEX_CHECK, timestamp, filesize, data_indexed, data_fingerprint(data_indexed));
+	out.write((char*)&nh, sizeof(nh));
+	if(!zones.empty())
+	{
+		out.write((const char *)&zones[0], zones.size()*sizeof(log_zone));
+	}
+	out.close();
+	if(!out || rename(tmpfn.c_str(), filename.c_str()) != 0)
+	{
+		ERROR("Cannot write index file '" + filename + "'");
+	}
+}
+
+//! Summarize the records of an unframed file past offset from in zones, returns the end of the last complete record
+uint64_t swarmdb::build_zones(std::vector<log_zone> &zones, uint64_t from) const
+{
+	std::vector<index_piece> pieces;
+	size_t nrecords;
+	uint64_t data_indexed = split_log_blocks(pieces, nrecords, blocks, from, ZONE_SIZE);
+
+	std::vector<log_zone> added(pieces.size());
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)pieces.size(); i++)
+	{
+		const index_piece &p = pieces[i];
+		swarm_block_header h;
+		gpulog::ilogstream ils(blocks[p.block].begin + p.begin, p.end - p.begin);
+		gpulog::logrecord lr;
+		while(lr = ils.next())
+		{
+			double T;
+			int sys;
+			get_Tsys(lr, T, sys);
+			h.add(T, sys);
+		}
+
+		log_zone lz = { p.block, h.nrecords, p.begin, p.end, h.Tmin, h.Tmax, h.sysmin, h.sysmax };
+		added[i] = lz;
+	}
+	zones.insert(zones.end(), added.begin(), added.end());
+
+	return data_indexed;
+}
+
+//! Length of the (uncompressed) data of the log file
+uint64_t swarmdb::data_size() const
+{
+	if(!segments.empty()) { return segment_offs.back() + segments.back()->data_size(); }
+	if(format != LOG_COMPRESSED) { return mmdata.size(); }
+	return blocks.empty() ? 0 : blocks.back().offs + blocks.back().len;
+}
+
+//! FNV-1a hash of n bytes at p, continuing the hash h
+static uint64_t fnv1a(uint64_t h, const void *p, size_t n)
+{
+	const unsigned char *c = (const unsigned char *)p;
+	for(size_t i = 0; i != n; i++) { h = (h ^ c[i]) * 1099511628211ULL; }
+	return h;
+}
+
+/*! Fingerprint of the data up to offset upto: a hash of the file header
+ *  (without the data length, which is written when the log is closed)
+ *  and of the data at the start and just before upto. For compressed
+ *  files the headers of the first block and of the block that ends at
+ *  upto are hashed instead.
+ */
+uint64_t swarmdb::data_fingerprint(uint64_t upto) const
+{
+	const uint64_t window = 4096;
+	uint64_t h = 14695981039346656037ULL;
+	upto = std::min(upto, data_size());
+
+	if(!segments.empty())
+	{
+		int i = segments.size() - 1;
+		while(i != 0 && segment_offs[i] >= upto) { i--; }
+
+		uint64_t fp = segments[0]->data_fingerprint(upto);
+		h = fnv1a(h, &fp, sizeof(fp));
+		if(i != 0)
+		{
+			fp = segments[i]->data_fingerprint(upto - segment_offs[i]);
+			h = fnv1a(h, &fp, sizeof(fp));
+		}
+		return h;
+	}
+
+	const swarm_header &fh = mmdata.hdr();
+	h = fnv1a(h, &fh, (const char *)&fh.datalen - (const char *)&fh);
+
+	if(format != LOG_COMPRESSED)
+	{
+		uint64_t n = std::min(upto, window);
+		h = fnv1a(h, mmdata.data(), n);
+		h = fnv1a(h, mmdata.data() + upto - n, n);
+		return h;
+	}
+
+	size_t b = blocks.size();
+	while(b != 0 && blocks[b-1].offs >= upto) { b--; }
+	if(b != 0)
+	{
+		h = fnv1a(h, blocks[0].hdr, sizeof(swarm_block_header));
+		h = fnv1a(h, blocks[b-1].hdr, sizeof(swarm_block_header));
+	}
+	return h;
+}
+
+//! Open the segments of a segmented log
+void swarmdb::open_segments(const std::vector<std::string> &files)
+{
+	if(files.empty())
+	{
+		ERROR("No segments listed in '" + datafile + "'");
+	}
+
+	// the segments are independent log files, open them in parallel
+	segments.resize(files.size());
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)files.size(); i++)
+	{
+		try
+		{
+			segments[i].reset(new swarmdb(files[i]));
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_segments)
+			error = e.what();
+		}
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
+
+	// the data of the manifest is the data of the segments one after the other
+	format = segments[0]->format;
+	uint64_t offs = 0;
+	for(int i = 0; i != segments.size(); i++)
+	{
+		if(segments[i]->format != format)
+		{
+			ERROR("Segments of '" + datafile + "' have different formats");
+		}
+
+		segment_offs.push_back(offs);
+		for(int b = 0; b != segments[i]->blocks.size(); b++)
+		{
+			log_block lb = segments[i]->blocks[b];
+			lb.offs += offs;
+			blocks.push_back(lb);
+		}
+		offs += segments[i]->data_size();
+	}
+
+	// the segments share the memory for decompressed blocks
+	if(format == LOG_COMPRESSED)
+	{
+		size_t max_bytes = std::max<size_t>(256*1024*1024/(segments.size() + 1), 16*1024*1024);
+		for(int i = 0; i != segments.size(); i++)
+		{
+			segments[i]->cache = block_cache((log::codec_t)segments[i]->mmdata.hdr().flags, max_bytes);
+		}
+		cache = block_cache((log::codec_t)segments[0]->mmdata.hdr().flags, max_bytes);
+	}
+}
+
+//! Build an index of a segmented log by merging the indexes of its segments
+template<typename Cmp>
+void swarmdb::merge_segment_index(index_handle swarmdb::*h, const std::string &suffix, const std::string &filetype) const
+{
+	std::string filename = datafile + suffix;
+	std::ofstream out(filename.c_str());
+
+	uint64_t timestamp, filesize;
+	get_file_info(timestamp, filesize, datafile);
+	swarm::swarm_index_header fh(filetype, timestamp, filesize, data_size(), data_fingerprint(data_size()));
+	out.write((char*)&fh, sizeof(fh));
+
+	// copy the segment indexes one after the other, with the offsets rebased
+	std::vector<size_t> runs(1, 0);
+	for(int i = 0; i != segments.size(); i++)
+	{
+		const index_handle &sh = (*segments[i]).*h;
+		for(const index_entry *e = sh.begin; e != sh.end; e++)
+		{
+			index_entry ie = *e;
+			ie.offs += segment_offs[i];
+			out.write((const char *)&ie, sizeof(ie));
+		}
+		runs.push_back(runs.back() + (sh.end - sh.begin));
+	}
+	out.close();
+
+	// the segment indexes are sorted already, merge them pairwise
+	mmapped_swarm_index_file mm(filename, filetype, MemoryMap::rw);
+	index_entry *begin = (index_entry *)mm.data();
+	assert(mm.size()/sizeof(index_entry) == runs.back());
+
+	size_t nruns = runs.size() - 1;
+	for(size_t width = 1; width < nruns; width *= 2)
+	{
+		for(size_t i = 0; i + width < nruns; i += 2*width)
+		{
+			std::inplace_merge(begin + runs[i], begin + runs[i + width], begin + runs[std::min(i + 2*width, nruns)], Cmp());
+		}
+	}
+}
+
+//! Open the indexes if they have not been opened yet
+void swarmdb::require_indexes() const
+{
+	if(indexed) { return; }
+
+	// queries may run in parallel, the first one opens the indexes
+	std::string error;
+	#pragma omp critical(swarm_indexes)
+	{
+		try
+		{
+			if(!indexed) { open_indexes(); }
+		}
+		catch(const std::exception &e)
+		{
+			error = e.what();
+		}
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
 }
 
 //! Open index map, recreate if not exists
-void swarmdb::open_indexes(bool force_recreate)
+void swarmdb::open_indexes(bool force_recreate) const
 {
-	std::vector<boost::shared_ptr<index_creator_base> > ic;
-	std::string fn;
+	index_handle *handles[NUM_RECORD_INDEXES] = { &idx_time, &idx_sys, &idx_evt };
 
-	// auto-create indices if needed
-	bool tidx_open = !force_recreate && open_index(idx_time, datafile, ".time.idx", "T_sorted_index");
-	if(!tidx_open)
+	// indexes of a segmented log are merged from those of the segments, they
+	// have to be merged again whenever one of the segments has been reindexed
+	if(!segments.empty())
 	{
-		boost::shared_ptr<index_creator_base> ii(new index_creator<index_entry_time_cmp>(".time.idx", "T_sorted_index"));
-		ic.push_back( ii );
+		// the segments are independent log files, index them in parallel
+		std::string error;
+		#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < (int)segments.size(); i++)
+		{
+			try
+			{
+				if(!segments[i]->indexed) { segments[i]->open_indexes(); }
+			}
+			catch(const std::exception &e)
+			{
+				#pragma omp critical(swarm_segments)
+				error = e.what();
+			}
+		}
+		if(!error.empty())
+		{
+			ERROR(error);
+		}
+
+		for(int i = 0; i != segments.size(); i++)
+		{
+			force_recreate = force_recreate || segments[i]->reindexed;
+		}
+
+		index_handle swarmdb::*members[NUM_RECORD_INDEXES] = { &swarmdb::idx_time, &swarmdb::idx_sys, &swarmdb::idx_evt };
+		for(int k = 0; k != NUM_RECORD_INDEXES; k++)
+		{
+			if(!force_recreate && open_index(*handles[k], datafile, record_index_suffix[k], record_index_filetype[k])) { continue; }
+
+			switch(k)
+			{
+			case TIME_INDEX: merge_segment_index<index_entry_time_cmp>(members[k], record_index_suffix[k], record_index_filetype[k]); break;
+			case SYS_INDEX:  merge_segment_index<index_entry_sys_cmp>(members[k], record_index_suffix[k], record_index_filetype[k]); break;
+			case EVT_INDEX:  merge_segment_index<index_entry_evt_cmp>(members[k], record_index_suffix[k], record_index_filetype[k]); break;
+			}
+			if(!open_index(*handles[k], datafile, record_index_suffix[k], record_index_filetype[k]))
+			{
+				ERROR("Cannot open index file '" + datafile + record_index_suffix[k] + "'");
+			}
+			reindexed = true;
+		}
+		indexed = true;
+		return;
 	}
-	bool sysidx_open = !force_recreate && open_index(idx_sys,  datafile, ".sys.idx", "sys_sorted_index");
-	if(!sysidx_open)
+
+	// auto-create indices if needed
+	bool open[NUM_RECORD_INDEXES];
+	for(int k = 0; k != NUM_RECORD_INDEXES; k++)
 	{
-		boost::shared_ptr<index_creator_base> ii(new index_creator<index_entry_sys_cmp>(".sys.idx", "sys_sorted_index"));
-		ic.push_back( ii );
+		open[k] = !force_recreate && open_index(*handles[k], datafile, record_index_suffix[k], record_index_filetype[k]);
 	}
 
-	// create indices if needed
-	if(!ic.empty())
+	// create indices if needed, if the data file has only grown
+	// since they were built just the new records are added
+	if(!open[TIME_INDEX] || !open[SYS_INDEX] || !open[EVT_INDEX])
 	{
-		index_binary_log_file(ic, datafile);
+		uint64_t from = swarm_header::npos;
+		for(int k = 0; k != NUM_RECORD_INDEXES; k++)
+		{
+			if(open[k]) { continue; }
+			if(from == swarm_header::npos) { from = handles[k]->data_indexed; }
+			if(handles[k]->data_indexed != from) { from = 0; }
+		}
+		build_indexes(!open[TIME_INDEX], !open[SYS_INDEX], !open[EVT_INDEX], from);
+		reindexed = true;
 	}
 
 	// open index maps
-	if(!tidx_open && !open_index(idx_time, datafile, ".time.idx", T_INDEX_CHECK ))
+	for(int k = 0; k != NUM_RECORD_INDEXES; k++)
 	{
-		ERROR("Cannot open index file '" + datafile + ".time.idx'");
+		if(!open[k] && !open_index(*handles[k], datafile, record_index_suffix[k], record_index_filetype[k]))
+		{
+			ERROR("Cannot open index file '" + datafile + record_index_suffix[k] + "'");
+		}
 	}
-	if(!sysidx_open && !open_index(idx_sys,  datafile, ".sys.idx", SYS_INDEX_CHECK))
+	indexed = true;
+}
+
+//! Open the body index, building it if needed. Returns true if it was (re)built
+bool swarmdb::open_body_index() const
+{
+	if(body_indexed) { return false; }
+
+	bool rebuilt = false;
+	if(!segments.empty())
 	{
-		ERROR("Cannot open index file '" + datafile + ".sys.idx'");
+		// merged from the body indexes of the segments, like the other indexes
+		std::string error;
+		#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < (int)segments.size(); i++)
+		{
+			try
+			{
+				if(segments[i]->open_body_index())
+				{
+					#pragma omp critical(swarm_segments)
+					rebuilt = true;
+				}
+			}
+			catch(const std::exception &e)
+			{
+				#pragma omp critical(swarm_segments)
+				error = e.what();
+			}
+		}
+		if(!error.empty())
+		{
+			ERROR(error);
+		}
+
+		if(rebuilt || !open_index(idx_body, datafile, ".body.idx", BODY_INDEX_CHECK))
+		{
+			merge_segment_index<index_entry_body_cmp>(&swarmdb::idx_body, ".body.idx", BODY_INDEX_CHECK);
+			rebuilt = true;
+		}
 	}
+	else if(!open_index(idx_body, datafile, ".body.idx", BODY_INDEX_CHECK))
+	{
+		build_body_index(idx_body.data_indexed);
+		rebuilt = true;
+	}
+
+	if(rebuilt && !open_index(idx_body, datafile, ".body.idx", BODY_INDEX_CHECK))
+	{
+		ERROR("Cannot open index file '" + datafile + ".body.idx'");
+	}
+	body_indexed = true;
+	return rebuilt;
 }
 
 //! Check if data index is up-to-date
-bool swarmdb::open_index(index_handle &h, const std::string &datafile, const std::string &suffix, const std::string &filetype)
+bool swarmdb::open_index(index_handle &h, const std::string &datafile, const std::string &suffix, const std::string &filetype) const
 {
 	std::string filename = datafile + suffix;
+	h.data_indexed = 0;
 
 	// check for existence
 	if(access(filename.c_str(), 04) != 0) { return false; }
 
-	
+	// indexes written by older versions are rebuilt
+	try
+	{
+		h.mm.open(filename.c_str(), filetype);
+	}
+	catch(const peyton::system::MemoryMapError &)
+	{
+		std::cerr << "Index " << filename << " has an incompatible format. Will regenerate.\n";
+		return false;
+	}
 
 	// check for modification timestamp and size
-	h.mm.open(filename.c_str(), filetype);
 	uint64_t timestamp, filesize;
 	get_file_info(timestamp, filesize, datafile);
 
 	//! todo: this quick fix is only for fake memory mapping
 	timestamp = h.mm.hdr().timestamp;
 
+	h.begin = (swarmdb::index_entry *)h.mm.data();
+	h.end   = h.begin + h.mm.size()/sizeof(swarmdb::index_entry);
+
 	if(h.mm.hdr().datafile_size != filesize || h.mm.hdr().timestamp != timestamp)
+	{
+		// the records of a data file that has grown are still where they were
+		if(h.mm.hdr().datafile_size < filesize && h.mm.hdr().data_indexed != 0 && h.mm.hdr().data_indexed <= data_size()
+			&& h.mm.hdr().data_fingerprint == data_fingerprint(h.mm.hdr().data_indexed))
+		{
+			// a log that is still being written may have grown again since it was
+			// mapped, an index of all the records that are mapped is up to date
+			if(segments.empty() && h.mm.hdr().data_indexed == data_end()) { return true; }
+
+			std::cerr << "Index " << filename << " not up to date. Will index the appended records.\n";
+			h.data_indexed = h.mm.hdr().data_indexed;
+			return false;
+		}
+
+		std::cerr << "Index " << filename << " not up to date. Will regenerate.\n";
+		return false;
+	}
+
+	// a data file rewritten with the same size and timestamp
+	if(h.mm.hdr().data_fingerprint != data_fingerprint(h.mm.hdr().data_indexed))
 	{
 		std::cerr << "Index " << filename << " not up to date. Will regenerate.\n";
 		return false;
 	}
 
-	h.begin = (swarmdb::index_entry *)h.mm.data();
-	h.end   = h.begin + h.mm.size()/sizeof(swarmdb::index_entry);
-	
 	return true;
 }
 
@@ -29,6 +29,9 @@
 
 #include "fileformat.hpp"
 #include "log.hpp"
+#include "compression.hpp"
+#include "snapshot_codec.hpp"
+#include "segments.hpp"
 
 namespace swarm { 
 	/**
@@ -37,16 +40,43 @@ namespace swarm {
 	 * a swarm log file.
 	 * Swarm log file is a binary file with a simple textual header
 	 * and a number of fixed size C structs (gpulog::logrecord).
+	 * In block-framed log files the records are grouped in blocks
+	 * with a swarm_block_header in front of each block. In
+	 * block-compressed log files each block is compressed on its own
+	 * and is decompressed on demand when it is read.
 	 *
 	 * swarmdb is used to open the log file and query it. API users
 	 * should only interact with swarmdb. 
 	 *
 	 * swarmdb uses indexes for fast retrieval of data. The indexes
-	 * are built the first time file is opened and then cached on
-	 * disk. There are two indexes:
+	 * are built the first time the file is queried and then cached on
+	 * disk. There are these indexes:
 	 *   1. Time index sorted based on time of records
 	 *   2. System index sorted based on system id of records
+	 *   3. Event index sorted based on event id and time of records,
+	 *      so rare events are found without reading the snapshots
+	 *   4. Body index sorted based on body, system id and time, with an
+	 *      entry for each body of a snapshot. It is only built when
+	 *      the file is first queried for a range of bodies.
+	 * The indexes record how much of the data file they cover. When
+	 * a log that is still being written is reopened, only the records
+	 * appended since then are indexed and merged into the indexes.
+	 *
+	 * A zone map with the time and system ranges of every block (or of
+	 * every 256kB of records of an unframed file) is kept in memory. It
+	 * is used to skip the data and the indexes for queries that cannot
+	 * match, and by scan(), which reads the matching zones in log order
+	 * without the indexes.
 	 * 
+	 * Compact snapshots (EVT_SNAPSHOT_DELTA) are expanded to full
+	 * EVT_SNAPSHOT records when they are read, starting from
+	 * the closest keyframe of the system.
+	 *
+	 * A segmented log (see log::log_segments) is opened through its
+	 * manifest. The segments are opened and indexed in parallel and
+	 * their indexes are merged into the indexes of the manifest, so
+	 * the segments are queried like one log file.
+	 *
 	 * Although sort_binary_output_file function can be used to sort
 	 * the entire data file, there is no reason to do so. Since all
 	 * the accesses to the file go through the index. 
@@ -62,6 +92,10 @@ namespace swarm {
 	extern const char* UNSORTED_HEADER_CHECK;
 	extern const char* SORTED_HEADER_FULL;
 	extern const char* SORTED_HEADER_CHECK;
+	extern const char* BLOCKED_HEADER_FULL;
+	extern const char* BLOCKED_HEADER_CHECK;
+	extern const char* COMPRESSED_HEADER_FULL;
+	extern const char* COMPRESSED_HEADER_CHECK;
 
 	extern struct range_special { } ALL;
 	extern struct range_MAX
@@ -95,19 +129,76 @@ namespace swarm {
 
 	typedef range<int> sys_range_t;
 	typedef range<int> body_range_t;
+	typedef range<int> evt_range_t;
 	typedef range<double> time_range_t;
 
 	typedef mmapped_file_with_header<swarm_header> mmapped_swarm_file;
 	typedef mmapped_file_with_header<swarm_index_header> mmapped_swarm_index_file;
-	  //!
-	struct index_creator_base
+
+	//! Get the time and system of a record, (-1,-1) for system-defined records
+	void get_Tsys(gpulog::logrecord &lr, double &T, int &sys);
+
+	//! Layouts of unsorted log files
+	enum log_file_format { LOG_UNFRAMED, LOG_FRAMED, LOG_COMPRESSED };
+
+	//! A run of back-to-back log records in a log file
+	struct log_block
+	{
+		uint64_t offs;			//!< offset of the first record in the (uncompressed) data
+		size_t len;			//!< length of the records in bytes
+		const swarm_block_header *hdr;	//!< block header, NULL for files that are not block-framed
+		const char *begin;		//!< first record of the block, NULL if the block is compressed
+	};
+
+	/*! Time and system id ranges of a run of records (a zone), so runs
+	 *  that cannot hold records of a query are skipped without reading them.
+	 *  The zones of block-framed files are their blocks.
+	 */
+	struct log_zone
 	{
-		virtual bool start(const std::string &datafile) = 0;
-		virtual bool add_entry(uint64_t offs, gpulog::logrecord lr) = 0;
-		virtual bool finish() = 0;
-		virtual ~index_creator_base() {};
+		int block;			//!< block of the records
+		uint32_t nrecords;		//!< number of records
+		uint64_t begin, end;		//!< byte range of the records in the block
+		double Tmin, Tmax;		//!< time range of the records
+		int32_t sysmin, sysmax;		//!< system id range of the records
+
+		bool overlaps(const range<int> &sys, const range<double> &T) const
+		{
+			return nrecords != 0 && Tmin <= T.last && T.first <= Tmax && sysmin <= sys.last && sys.first <= sysmax;
+		}
 	};
 
+	//! Open an unsorted log file and detect its layout
+	log_file_format open_log_file(mmapped_swarm_file &mm, const std::string &datafile);
+
+	//! Split a log file into blocks of records. Files that are not
+	//! block-framed are returned as one block without a header
+	void get_log_blocks(std::vector<log_block> &blocks, const mmapped_swarm_file &mm, log_file_format format);
+
+	/*! Decompressed blocks of a block-compressed log file.
+	 *
+	 * Blocks are decompressed on first access and the oldest are forgotten
+	 * when more than max_bytes are cached. The callers share the ownership
+	 * of the blocks, a block that is forgotten stays valid while it is used.
+	 */
+	class block_cache
+	{
+	public:
+		typedef boost::shared_ptr<std::vector<char> > Pbuffer;
+
+	private:
+		log::codec_t codec;
+		size_t max_bytes, bytes;
+		std::map<const swarm_block_header *, Pbuffer> blocks;
+		std::deque<const swarm_block_header *> order;
+
+	public:
+		block_cache(log::codec_t codec_ = log::CODEC_NONE, size_t max_bytes_ = 256*1024*1024)
+			: codec(codec_), max_bytes(max_bytes_), bytes(0) {}
+
+		//! Buffer with the records of block b
+		Pbuffer get(const log_block &b);
+	};
 	  //! Defines swarmdb class
 	class swarmdb
 	{
@@ -120,23 +211,68 @@ namespace swarm {
 			double T;	//!< time
 			int sys;	//!< system at the record
 			int body;	//!< bod at/in the record
+			int evt;	//!< event id of the record
 		};
 
+		//! buffer that keeps a decompressed block or an expanded snapshot in memory
+		typedef block_cache::Pbuffer Pbuffer;
+
 	protected:
 		struct index_handle
 		{
 			mmapped_swarm_index_file mm;
 			const index_entry *begin, *end;
+			//! data offset up to which an outdated index is still valid, 0 if it has to be rebuilt
+			uint64_t data_indexed;
 		};
 
 		mmapped_swarm_file mmdata;
+		log_file_format format;
+		std::vector<log_block> blocks;
+		mutable block_cache cache;
 
-		index_handle idx_time, idx_sys;
+		//! zone map of the records, always in memory
+		std::vector<log_zone> zones;
+		void open_zones();
+		//! offset of the data at the end of zone z
+		uint64_t zone_end(int z) const { return blocks[zones[z].block].offs + zones[z].end; }
+		uint64_t build_zones(std::vector<log_zone> &zones, uint64_t from) const;
+
+		//! the indexes are opened by the first query that needs them
+		mutable index_handle idx_time, idx_sys, idx_evt;
 		std::string datafile;
+		mutable bool indexed;
+		//! whether the indexes were (re)built when they were opened
+		mutable bool reindexed;
+		void require_indexes() const;
+
+		//! index by body, system and time, opened by the first body query
+		mutable index_handle idx_body;
+		mutable bool body_indexed;
+		bool open_body_index() const;
+		void build_body_index(uint64_t from) const;
+
+		//! segments of a segmented log, empty for a single log file
+		std::vector<boost::shared_ptr<swarmdb> > segments;
+		//! offset of the first record of each segment in the data of the manifest
+		std::vector<uint64_t> segment_offs;
+
+		uint64_t data_size() const;
+		void open_segments(const std::vector<std::string> &files);
+		template<typename Cmp>
+		void merge_segment_index(index_handle swarmdb::*h, const std::string &suffix, const std::string &filetype) const;
+
+		//! expanded compact snapshots, by offset of their EVT_SNAPSHOT_DELTA record
+		mutable std::map<uint64_t, Pbuffer> decoded;
+		mutable std::deque<uint64_t> decoded_order;
+		mutable size_t decoded_bytes;
+
+		const index_entry *find_snapshot(int sys, double T, uint64_t before) const;
+		Pbuffer decode_snapshot(const index_entry &ie) const;
 
 		void open(const std::string &datafile);
-		void open_indexes(bool force_recreate = false);
-		bool open_index(index_handle &h, const std::string &datafile, const std::string &suffix, const std::string &filetype);
+		void open_indexes(bool force_recreate = false) const;
+		bool open_index(index_handle &h, const std::string &datafile, const std::string &suffix, const std::string &filetype) const;
 
 	  //! Defines query result structure
 	public:
@@ -145,15 +281,41 @@ namespace swarm {
 			const swarmdb &db;
 
 			sys_range_t  sys;
-		  //			body_range_t  body;
+			body_range_t  body;
 			time_range_t T;
+			evt_range_t  evt;
 			
 			const index_entry *begin, *end, *at, *atprev;
 
+			//! body of the last record returned by a body query, -1 otherwise
+			int bod;
+
+			//! ranges of the sys index (one per system) that are merged by
+			//! time, for queries on a few systems and a long time window
+			typedef std::pair<const index_entry *, const index_entry *> index_range;
+			std::vector<index_range> ranges;
+			std::vector<int> heap;
+			int prevrange;
+
+			//! position in the zone map of a query in log order, zone is -1 otherwise
+			struct in_log_order {};
+			int zone, zoneprev;
+			const char *zdata;
+			uint64_t zat, zend, zatprev;
+
+			//! buffers of the current zone and of the last record returned,
+			//! a record stays valid until the next call to next()
+			Pbuffer zhold, hold;
+
 		  result(const swarmdb &db_, const sys_range_t &sys, const time_range_t &T);
-		  //		  result(const swarmdb &db_, const sys_range_t &sys, const body_range_t &body, const time_range_t &T);
+		  result(const swarmdb &db_, const sys_range_t &sys, const body_range_t &body, const time_range_t &T);
+		  result(const swarmdb &db_, const sys_range_t &sys, const time_range_t &T, const evt_range_t &evt);
+		  result(const swarmdb &db_, const sys_range_t &sys, const time_range_t &T, in_log_order, uint64_t from = 0);
 
 			gpulog::logrecord next();
+			gpulog::logrecord next_merged();
+			gpulog::logrecord next_scanned();
+			void load_zone(int z);
 			void unget();
 		};
 
@@ -161,18 +323,101 @@ namespace swarm {
 	public:
 		swarmdb(const std::string &datafile);
 
+		//! blocks of records in the data file (one block if the file is not block-framed)
+		const std::vector<log_block> &get_blocks() const { return blocks; }
+
+		//! records of a block, decompressing it if needed. The records stay valid while hold is kept
+		const char *block_data(const log_block &b, Pbuffer &hold) const
+		{
+			if(b.begin != NULL) { return b.begin; }
+			hold = cache.get(b);
+			return &(*hold)[0];
+		}
+
+		//! record at offset offs of the (uncompressed) data, valid while hold is kept
+		const char *record(uint64_t offs, Pbuffer &hold) const;
+
+		//! record of an index entry, with compact snapshots expanded to EVT_SNAPSHOT records, valid while hold is kept
+		const char *get_record(const index_entry &ie, Pbuffer &hold) const;
+
 		//! return a stream of events with msgid, and system sys, at time T
 	  result query(sys_range_t sys, time_range_t T) const
 		{
 		  return result(*this, sys, T);
 		}
 
-	  /*
+	  /*! return a stream of the records about bodies in the range body, ordered
+	   *  by body, system and time. A snapshot is returned once for each
+	   *  of its bodies in the range, result::bod tells which one.
+	   */
 	  result query(sys_range_t sys, body_range_t body, time_range_t T) const
 		{
+		  if(body.first == int(MIN) && body.last == int(MAX)) { return result(*this, sys, T); }
 		  return result(*this, sys, body, T);
 		}
-	  */
+	  //! return a stream of the records with event ids in the range evt, ordered by event id, time and system
+	  result query_events(evt_range_t evt, sys_range_t sys, time_range_t T) const
+		{
+		  if(evt.first == int(MIN) && evt.last == int(MAX)) { return result(*this, sys, T); }
+		  return result(*this, sys, T, evt);
+		}
+
+	  /*! return the records of systems sys in the time range T in the order they
+	   *  are stored, starting at offset from of the data. Only the zones that may
+	   *  hold such records are read, and the indexes are not needed (except to
+	   *  expand compact snapshots).
+	   */
+	  result scan(sys_range_t sys, time_range_t T, uint64_t from = 0) const
+		{
+		  return result(*this, sys, T, result::in_log_order(), from);
+		}
+
+		//! zone map of the records
+		const std::vector<log_zone> &get_zones() const { return zones; }
+
+		/*! offset of the data just past the last complete record. Records that
+		 *  are appended to the log later are found with scan(sys, T, data_end())
+		 *  on a swarmdb opened again.
+		 */
+		uint64_t data_end() const
+		{
+			return zones.empty() ? 0 : zone_end(zones.size() - 1);
+		}
+
+		/*! fingerprint of the data up to offset upto, tells whether a file
+		 *  that was read up to there has been rewritten since
+		 */
+		uint64_t data_fingerprint(uint64_t upto) const;
+
+		//! whether any zone may hold records of systems sys in the time range T
+		bool may_contain(const sys_range_t &sys, const time_range_t &T) const;
+
+		/*! ranges of the system index with the records of each system in sys in
+		 *  the time range T, in system order. The records of a range are in time
+		 *  order and can be read by different threads with get_record, so
+		 *  per-system reductions are computed in parallel.
+		 */
+		void system_ranges(std::vector<result::index_range> &ranges, sys_range_t sys, time_range_t T) const;
+
+		//! Number of records and their time range, NaN if there are none
+		struct count_t
+		{
+			int sys;		//!< system of a per-system count, -1 otherwise
+			uint64_t n;		//!< number of records
+			double Tmin, Tmax;	//!< times of the first and the last record
+		};
+
+		/*! number and time range of the records of systems sys in the time range T
+		 *  with event ids evt, without reading the records. Whole zones of the zone
+		 *  map are counted as they are, otherwise the records are counted in the
+		 *  system index (or in the event index, if evt is not ALL). Compact
+		 *  snapshots count as snapshots, system-defined records are not counted.
+		 */
+		count_t count(sys_range_t sys, time_range_t T, evt_range_t evt = evt_range_t()) const;
+
+		//! count() of every system with matching records, in system order
+		void count_systems(std::vector<count_t> &counts, sys_range_t sys, time_range_t T, evt_range_t evt = evt_range_t()) const;
+
 	  //! Defines snapshots structure
 	public:
 		struct snapshots
@@ -190,11 +435,22 @@ namespace swarm {
 		{
 			return snapshots(*this, T, Tabserr, Trelerr);
 		}
+
+		/*! state of every system at its last snapshot at or before time T.
+		 *
+		 *  The snapshots are looked up in the system index, which is ordered
+		 *  by system and time, so the earlier records are not read. Each system
+		 *  keeps the time of its snapshot, systems without a snapshot before T
+		 *  are inactive. Returns false if there is no such snapshot at all.
+		 */
+		bool snapshot_at(cpu_ensemble &ens, double T) const;
 	private:
-		void index_binary_log_file(std::vector<boost::shared_ptr<index_creator_base> > &ic, const std::string &datafile);
+		void build_indexes(bool time, bool sys, bool evt, uint64_t from = 0) const;
+		void event_ranges(std::vector<result::index_range> &ranges, evt_range_t evt, time_range_t T) const;
 	};
 
-	bool sort_binary_log_file(const std::string &outfn, const std::string &infn);
+	//! Sort a log file by time and system using at most about max_memory bytes, temporary files go to tmpdir
+	bool sort_binary_log_file(const std::string &outfn, const std::string &infn, size_t max_memory = 1024*1024*1024, const std::string &tmpdir = "");
 
 } } // end namespace query:: swarm
 
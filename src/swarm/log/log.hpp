@@ -202,6 +202,8 @@ static const int EVT_ENCOUNTER		= 3;
 static const int EVT_COLLISION		= 4;	
 //! marks near a collision with central body
 static const int EVT_COLLISION_CENTRAL	= 5;	
+//! marks a compact snapshot of a system, see swarm::log::snapshot_encoder
+static const int EVT_SNAPSHOT_DELTA	= 6;	
   // Common types of observations
 //! marks near a transit of planet in front of star
 static const int EVT_RV_OBS		= 11;	
@@ -40,27 +40,32 @@ Pmanager& manager::default_log() {
 	if( !is_initialized ){
 		config cfg; cfg["log_writer"] = "null";
 		//		default_manager->init(cfg);
-		default_manager->init(cfg,0,0);
+		default_manager->init(cfg,0,0,0);
 		is_initialized = true;
 	}
 	return default_manager;
 }
 
 //! Initialize the log writer
-void manager::init(const config& cfg, int host_buffer_size, int device_buffer_size)
+void manager::init(const config& cfg, int host_buffer_size, int device_buffer_size, int printf_buffer_size)
 {
 	log_writer = writer::create(cfg);
+	log_filter.reset(filter::create(cfg));
 
 	// log memory allocation
+	hprintf.alloc(printf_buffer_size);
 	hlog.alloc(host_buffer_size);
-	pdlog = gpulog::alloc_device_log(device_buffer_size);
+	hlog.set_printf_channel(&hprintf);
+
+	pdprintf = gpulog::alloc_device_log(printf_buffer_size);
+	pdlog = gpulog::alloc_device_log(device_buffer_size, pdprintf);
 }
 //! Reset the log manager
 void manager::shutdown()
 {
 	config cfg; cfg["log_writer"] = "null";
 	//	swarm::log::manager::init(cfg);
-	swarm::log::manager::init(cfg,0,0);
+	swarm::log::manager::init(cfg,0,0,0);
 }
 
 //! Flush the output buffer for both host and device
@@ -75,16 +80,32 @@ void manager::flush(int flags)
 		ERROR( "No output writer attached!\n" );
 	}
 
+	// replay the CPU and GPU printf channels, they are
+	// small so the event logs are only traversed by the writer
+	replay_printf(std::cerr, hprintf);
+	copy(hprintf, pdprintf, gpulog::LOG_DEVCLEAR);
+	replay_printf(std::cerr, hprintf);
+	hprintf.clear();
+
 	// flush the CPU and GPU buffers
-	replay_printf(std::cerr, hlog);
-	log_writer->process(hlog.internal_buffer(), hlog.size());
+	output(hlog);
 
 	copy(hlog, pdlog, gpulog::LOG_DEVCLEAR);
-	replay_printf(std::cerr, hlog);
-	log_writer->process(hlog.internal_buffer(), hlog.size());
+	output(hlog);
 
 	hlog.clear();
 }
 
+//! Filter the records in place and pass what is left to the writer
+void manager::output(gpulog::host_log &log)
+{
+	size_t len = log.size();
+	if(log_filter.get())
+	{
+		len = log_filter->apply(log.internal_buffer(), len);
+	}
+	log_writer->process(log.internal_buffer(), len);
+}
+
 }
 }
@@ -27,6 +27,7 @@
 #include "../common.hpp"
 #include "log.hpp"
 #include "writer.h"
+#include "filter.hpp"
 
 
 namespace swarm { namespace log {
@@ -37,6 +38,11 @@ namespace swarm { namespace log {
  *   - host_log   : log data structure on host memory
  *   - device_log : log data structure on device memory.
  *   - writer     : provider class to write to desired output device
+ *   - filter     : drops unwanted records before they reach the writer (optional)
+ *
+ *  lprintf messages do not go into the event logs. Both host_log and
+ *  device_log have a small companion log (the printf channel) that
+ *  receives them, so writers only ever see event records.
  *  
  *  Purpose:
  *   - Stream log messages from device_log to host_log to writer
@@ -59,12 +65,24 @@ class manager {
 	gpulog::host_log hlog;
 	//! Device log used by GPU integrators
 	gpulog::device_log* pdlog;
+	//! printf channel of hlog
+	gpulog::host_log hprintf;
+	//! printf channel of pdlog
+	gpulog::device_log* pdprintf;
 	//! Writer plugin to output to a file
 	Pwriter log_writer;
+	//! Filter stage in front of the writer, NULL if all records are written
+	Pfilter log_filter;
 
 	//! Size of the log buffer if it is not specified
 	//! in the config file \todo: Add to CMake parameters
 	static const int default_buffer_size = 50*1024*1024;
+	//! Size of the printf channels, printf records that do not
+	//! fit between two flushes are dropped
+	static const int default_printf_buffer_size = 256*1024;
+
+	//! Filter the records in log and pass them on to the writer
+	void output(gpulog::host_log &log);
 	public:
 
 	enum { memory = 0x01, if_full = 0x02 };
@@ -72,15 +90,17 @@ class manager {
 	/*! Initialize logging system
 	 * - Allocates memory for host_log
 	 * - Allocates memory for device_log
+	 * - Allocates memory for the printf channels
 	 * - Select plugin for writer
 	 * - Configure writer plugin
+	 * - Configure the filter stage
 	 */
-	void init(const config&, int host_buffer_size = default_buffer_size, int device_buffer_size = default_buffer_size);
+	void init(const config&, int host_buffer_size = default_buffer_size, int device_buffer_size = default_buffer_size, int printf_buffer_size = default_printf_buffer_size);
 
 	/*! Stream the log from host_log and device_log to the output.
-	 * - Replay lprintf
+	 * - Replay lprintf from the printf channels
 	 * - Download device_log to host_log
-	 * - Output host_log to writer
+	 * - Filter host_log and output it to writer
 	 */
 	void flush(int flags = memory);
 
@@ -0,0 +1,101 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file segments.cpp
+ *    \brief Implements segmented log output and reading of the manifest.
+ *
+ *
+ */
+
+#include "../common.hpp"
+#include "../peyton/util.hpp"
+#include "segments.hpp"
+
+namespace swarm { namespace log {
+
+const char* MANIFEST_HEADER = "swarm_log_manifest";
+
+log_segments::log_segments(const config &cfg)
+	: bytes(0), Tmin(std::numeric_limits<double>::max()), Tmax(-std::numeric_limits<double>::max())
+{
+	binfn = cfg.at("log_output");
+	max_bytes = (uint64_t)cfg.optional("log_segment_size", 0.0);
+	max_time = cfg.optional("log_segment_time", 0.0);
+	if(cfg.optional("log_segment_size", 0.0) < 0 || max_time < 0)
+		ERROR("Segment limits must be positive.");
+}
+
+//! Name of the file of a segment without the directory
+static std::string segment_basename(const std::string &fn)
+{
+	size_t slash = fn.rfind('/');
+	return slash == std::string::npos ? fn : fn.substr(slash + 1);
+}
+
+//! Rewrite the manifest, readers never see a partially written one
+void log_segments::write_manifest() const
+{
+	std::string fn = binfn + ".manifest", tmpfn = fn + ".tmp";
+	{
+		std::ofstream out(tmpfn.c_str());
+		out << MANIFEST_HEADER << "\n";
+		for(int i = 0; i != names.size(); i++)
+		{
+			out << segment_basename(names[i]) << "\n";
+		}
+		if(!out)
+			ERROR("Could not write '" + tmpfn + "'");
+	}
+	if(rename(tmpfn.c_str(), fn.c_str()) != 0)
+		ERROR("Could not write '" + fn + "'");
+}
+
+//! Start a new segment
+std::string log_segments::next()
+{
+	char suffix[32];
+	sprintf(suffix, ".%04d.raw", (int)names.size());
+	names.push_back(binfn + suffix);
+	write_manifest();
+
+	bytes = 0;
+	Tmin = std::numeric_limits<double>::max(); Tmax = -Tmin;
+	return names.back();
+}
+
+//! Read the segment list of a manifest
+bool read_log_manifest(std::vector<std::string> &segments, const std::string &fn)
+{
+	std::ifstream in(fn.c_str());
+	std::string line;
+	if(!std::getline(in, line) || trim(line) != MANIFEST_HEADER) { return false; }
+
+	size_t slash = fn.rfind('/');
+	std::string dir = slash == std::string::npos ? "" : fn.substr(0, slash + 1);
+
+	segments.clear();
+	while(std::getline(in, line))
+	{
+		line = trim(line);
+		if(line.empty()) { continue; }
+		segments.push_back(line[0] == '/' ? line : dir + line);
+	}
+	return true;
+}
+
+} }
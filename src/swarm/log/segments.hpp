@@ -0,0 +1,91 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file segments.hpp
+ *    \brief Defines segmented log output: rotation into numbered files listed in a manifest.
+ *
+ *
+ */
+
+#pragma once
+#include "../common.hpp"
+#include "../types/config.hpp"
+
+namespace swarm { namespace log {
+
+/**
+ *   \brief Rotation of a writer's output into numbered segments.
+ *
+ *   If log_segment_size or log_segment_time is set, the output goes to
+ *   <log_output>.0000.raw, <log_output>.0001.raw, ... instead of
+ *   <log_output>.raw. Each segment is a complete log file with its own
+ *   swarm_header (and index once it is opened). <log_output>.manifest
+ *   lists the segments; it is rewritten whenever a segment is started
+ *   and can be opened with swarmdb like a single log file.
+ *
+ *   A new segment is started when the current one holds at least
+ *   log_segment_size bytes or its records span log_segment_time
+ *   units of time. Writers only rotate between two flushes
+ *   of the log, so the segment limits are not exact.
+ */
+class log_segments
+{
+	std::string binfn;
+	uint64_t max_bytes;
+	double max_time;
+	std::vector<std::string> names;
+
+	uint64_t bytes;
+	double Tmin, Tmax;
+
+	void write_manifest() const;
+
+public:
+	log_segments(const config &cfg);
+
+	//! Whether the output is segmented at all
+	bool enabled() const { return max_bytes != 0 || max_time != 0; }
+	//! Whether the time of the records is needed
+	bool by_time() const { return max_time != 0; }
+
+	//! Account for nbytes written to the current segment
+	void add(uint64_t nbytes) { bytes += nbytes; }
+	//! Account for a record at time T in the current segment
+	void add_time(double T) { Tmin = std::min(Tmin, T); Tmax = std::max(Tmax, T); }
+
+	//! Check if the current segment is full
+	bool full() const
+	{
+		return (max_bytes != 0 && bytes >= max_bytes) || (max_time != 0 && Tmax - Tmin >= max_time);
+	}
+
+	//! Start a new segment, returns the name of its file
+	std::string next();
+};
+
+//! Header line of a manifest of a segmented log
+extern const char* MANIFEST_HEADER;
+
+/*!
+ * Read the segment list of a segmented log. Segment names are resolved
+ * relative to the directory of the manifest. Returns false if fn is
+ * not a manifest.
+ */
+bool read_log_manifest(std::vector<std::string> &segments, const std::string &fn);
+
+} }
@@ -0,0 +1,212 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file snapshot_codec.cpp
+ *    \brief Implements encoding and decoding of compact snapshot records.
+ *
+ *
+ */
+
+#include "snapshot_codec.hpp"
+
+namespace swarm { namespace log {
+
+//! Number of doubles per body that are delta-encoded (x, y, z, vx, vy, vz)
+static const int NCOORD = 6;
+
+//! Positions and velocities of a body as 64-bit words
+static inline void get_words(uint64_t w[NCOORD], const body &b)
+{
+	const double v[NCOORD] = { b.x, b.y, b.z, b.vx, b.vy, b.vz };
+	memcpy(w, v, sizeof(v));
+}
+
+//! Store positions and velocities of a body from 64-bit words
+static inline void set_words(body &b, const uint64_t w[NCOORD])
+{
+	double v[NCOORD];
+	memcpy(v, w, sizeof(v));
+	b.x = v[0]; b.y = v[1]; b.z = v[2];
+	b.vx = v[3]; b.vy = v[4]; b.vz = v[5];
+}
+
+/*!
+ * XOR-encode the bodies against the reference bodies. A nibble
+ * with the number of significant bytes of every value comes first,
+ * followed by the significant (low order) bytes of the values.
+ */
+static void encode_bodies(std::vector<unsigned char> &out, const body *cur, const body *ref, int nbod)
+{
+	const int nval = nbod*NCOORD;
+	out.assign((nval+1)/2, 0);
+
+	for(int bod = 0; bod != nbod; bod++)
+	{
+		uint64_t c[NCOORD], r[NCOORD];
+		get_words(c, cur[bod]);
+		get_words(r, ref[bod]);
+		for(int j = 0; j != NCOORD; j++)
+		{
+			const int i = bod*NCOORD + j;
+			const uint64_t x = c[j] ^ r[j];
+
+			int n = 0;
+			while(n < 8 && (x >> (8*n)) != 0) { n++; }
+
+			out[i/2] |= n << (4*(i%2));
+			for(int k = 0; k != n; k++)
+			{
+				out.push_back((x >> (8*k)) & 0xff);
+			}
+		}
+	}
+}
+
+//! Inverse of encode_bodies(), returns false if the payload is corrupted
+static bool decode_bodies(body *cur, const unsigned char *in, int nbytes, int nbod)
+{
+	const int nval = nbod*NCOORD;
+	const unsigned char *data = in + (nval+1)/2, *end = in + nbytes;
+
+	for(int bod = 0; bod != nbod; bod++)
+	{
+		uint64_t w[NCOORD];
+		get_words(w, cur[bod]);
+		for(int j = 0; j != NCOORD; j++)
+		{
+			const int i = bod*NCOORD + j;
+			const int n = (in[i/2] >> (4*(i%2))) & 0xf;
+			if(n > 8 || data + n > end) { return false; }
+
+			uint64_t x = 0;
+			for(int k = 0; k != n; k++)
+			{
+				x |= uint64_t(*data++) << (8*k);
+			}
+			w[j] ^= x;
+		}
+		set_words(cur[bod], w);
+	}
+	return data == end;
+}
+
+//! Make sure the log has room for len bytes and empty it
+static void reserve(gpulog::host_log &l, size_t len)
+{
+	if(l.capacity() < len)
+	{
+		l.free();
+		l.alloc(len);
+	}
+	l.clear();
+}
+
+//! Test if masses and ids of the bodies match (they are not delta-encoded)
+static bool same_bodies(const body *a, const body *b, int nbod)
+{
+	for(int bod = 0; bod != nbod; bod++)
+	{
+		if(a[bod].mass != b[bod].mass || a[bod].body_id != b[bod].body_id) { return false; }
+	}
+	return true;
+}
+
+//!
+gpulog::logrecord snapshot_encoder::encode(gpulog::logrecord lr)
+{
+	if(lr.msgid() != EVT_SNAPSHOT) { return lr; }
+
+	double T; int sys, flags, nbod; const body *bodies;
+	gpulog::logrecord in = lr;
+	in >> T >> sys >> flags >> nbod >> bodies;
+
+	sysstate &s = systems[sys];
+	bool keyframe = (int)s.bodies.size() != nbod || ++s.since_keyframe >= keyframe_interval
+		|| s.T == T || !same_bodies(bodies, &s.bodies[0], nbod);
+
+	if(!keyframe)
+	{
+		encode_bodies(payload, bodies, &s.bodies[0], nbod);
+	}
+
+	double Tref = s.T;
+	s.T = T;
+	s.bodies.assign(bodies, bodies + nbod);
+
+	if(keyframe)
+	{
+		s.since_keyframe = 0;
+		return lr;
+	}
+
+	reserve(out, 128 + payload.size());
+	unsigned char *p = out.write(EVT_SNAPSHOT_DELTA, T, sys, flags, nbod, Tref, (int)payload.size(), gpulog::array<unsigned char>(payload.size()));
+	memcpy(p, &payload[0], payload.size());
+
+	return gpulog::logrecord(out.internal_buffer());
+}
+
+//!
+snapshot_encoder *snapshot_encoder::create(const config &cfg)
+{
+	std::string encoding = cfg.optional("log_snapshot_encoding", std::string("full"));
+	if(encoding == "full") { return NULL; }
+	if(encoding != "delta")
+		ERROR("Unknown log_snapshot_encoding '" + encoding + "', expected full or delta");
+
+	int interval = cfg.optional("log_keyframe_interval", 32);
+	if(interval < 1)
+		ERROR("log_keyframe_interval must be positive");
+
+	return new snapshot_encoder(interval);
+}
+
+//!
+double snapshot_reference_time(gpulog::logrecord delta)
+{
+	double T, Tref; int sys, flags, nbod;
+	delta >> T >> sys >> flags >> nbod >> Tref;
+	return Tref;
+}
+
+//!
+bool decode_snapshot(std::vector<char> &out, gpulog::logrecord delta, gpulog::logrecord ref)
+{
+	double T, Tref; int sys, flags, nbod, nbytes; const unsigned char *payload;
+	delta >> T >> sys >> flags >> nbod >> Tref >> nbytes >> payload;
+
+	double Tr; int sysr, flagsr, nbodr; const body *refbodies;
+	ref >> Tr >> sysr >> flagsr >> nbodr >> refbodies;
+	if(ref.msgid() != EVT_SNAPSHOT || sysr != sys || Tr != Tref || nbodr != nbod) { return false; }
+
+	// the full record has the layout of the reference record, its padding is cleared
+	// so that expanding a snapshot always gives the same bytes
+	gpulog::host_log l;
+	reserve(l, ref.len());
+	memset(l.internal_buffer(), 0, l.capacity());
+	body *bodies = l.write(EVT_SNAPSHOT, T, sys, flags, nbod, gpulog::array<body>(nbod));
+	if(bodies == NULL) { return false; }
+
+	std::copy(refbodies, refbodies + nbod, bodies);
+	if(!decode_bodies(bodies, payload, nbytes, nbod)) { return false; }
+
+	out.assign(l.internal_buffer(), l.internal_buffer() + l.size());
+	return true;
+}
+
+} }
@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file snapshot_codec.hpp
+ *    \brief Defines the compact (delta-encoded) snapshot records of binary log files.
+ *
+ *
+ */
+
+#pragma once
+#include "../common.hpp"
+#include "../types/config.hpp"
+
+#include "log.hpp"
+
+namespace swarm { namespace log {
+
+/**
+ *   \brief Replaces EVT_SNAPSHOT records by compact EVT_SNAPSHOT_DELTA records.
+ *
+ *   Every log_keyframe_interval-th snapshot of a system is kept as a full
+ *   EVT_SNAPSHOT record (a keyframe). The snapshots in between are
+ *   stored as EVT_SNAPSHOT_DELTA records:
+ *
+ *   (T, sys, flags, nbod, Tref, nbytes, unsigned char payload[nbytes])
+ *
+ *   where Tref is the time of the previous snapshot of the same system.
+ *   The payload holds positions and velocities XOR-ed with those of the
+ *   previous snapshot with the leading zero bytes dropped. Masses and
+ *   body ids are only stored in the keyframes.
+ *
+ *   The encoder runs on the host, in the writers, so the GPU
+ *   side of the logging system is not affected.
+ */
+class snapshot_encoder
+{
+	struct sysstate
+	{
+		double T;
+		int since_keyframe;
+		std::vector<body> bodies;
+	};
+
+	int keyframe_interval;
+	std::map<int, sysstate> systems;
+	std::vector<unsigned char> payload;
+	gpulog::host_log out;
+
+public:
+	snapshot_encoder(int keyframe_interval_ = 32) : keyframe_interval(keyframe_interval_) {}
+
+	//! Encode the record if it is a snapshot. The returned record is
+	//! valid until the next call
+	gpulog::logrecord encode(gpulog::logrecord lr);
+
+	//! Forget the previous snapshots, the next snapshot of every system is a keyframe
+	void reset() { systems.clear(); }
+
+	//! Create an encoder from log_snapshot_encoding, NULL if snapshots are stored in full
+	static snapshot_encoder *create(const config &cfg);
+};
+
+/*!
+ * Expand an EVT_SNAPSHOT_DELTA record to the full EVT_SNAPSHOT record
+ * it encodes. ref is the (full) previous snapshot of the same system. The
+ * result is stored in out, returns false if the records do not match.
+ */
+bool decode_snapshot(std::vector<char> &out, gpulog::logrecord delta, gpulog::logrecord ref);
+
+//! Get the time of the snapshot an EVT_SNAPSHOT_DELTA record was encoded against
+double snapshot_reference_time(gpulog::logrecord delta);
+
+} }
@@ -30,6 +30,9 @@
 
 #include "query.hpp"
 #include "kepler.h"
+#include "format.hpp"
+#include <omp.h>
+#include <unistd.h>
 
 
 namespace swarm { namespace query {
@@ -37,20 +40,6 @@ namespace swarm { namespace query {
 using log::body;
 
 
-void get_Tsys(gpulog::logrecord &lr, double &T, int &sys)
-{
-	//std::cerr << "msgid=" << lr.msgid() << "\n";
-	if(lr.msgid() < 0)
-	{
-		// system-defined events that have no (T,sys) heading
-		T = -1; sys = -1;
-	}
-	else
-	{
-		lr >> T >> sys;
-	}
-}
-
 // Default output, if no handler is registered
     std::ostream& record_output_default(std::ostream &out, gpulog::logrecord &lr)
 {
@@ -72,25 +61,16 @@ void set_cartesian_output(const planets_coordinate_system_t& coordinate_system)
 void set_coordinate_system(const planets_coordinate_system_t& coordinate_system)  
 {  planets_coordinate_system = coordinate_system; }
 
+output_format_t output_format = text_format;
+
+void set_output_format(const output_format_t& format)
+{  output_format = format; }
+
 
 struct keplerian_t {
 	double a, e, i, O, w , M;
 };
 
-keplerian_t keplerian_for_cartesian ( const body& b, const body& center ) 
-{ 
-  keplerian_t k;
-  double x = b.x - center.x;
-  double y = b.y - center.y;
-  double z = b.z - center.z;
-  double vx = b.vx - center.vx;
-  double vy = b.vy - center.vy;
-  double vz = b.vz - center.vz;
-  double mass = b.mass + center.mass;
-  calc_keplerian_for_cartesian(k.a, k.e, k.i, k.O, k.w, k.M, x, y,z, vx, vy, vz, mass );
-  return k;
-}
-
 body center_of_mass(const body* bodies, const int nbod ){ 
 	body center;
 	center.x = center.y = center.z = center.vx = center.vy = center.vz = 0.;
@@ -117,14 +97,9 @@ body center_of_mass(const body* bodies, const int nbod ){
 	return center;
 }
 
-// EVT_SNAPSHOT
-    std::ostream& record_output_1(std::ostream &out, gpulog::logrecord &lr, body_range_t &body_range)
+//! Center of the coordinate frame of a snapshot (for Jacobi coordinates, of its first planet)
+body frame_center(const body* bodies, const int nbod)
 {
-	double time;
-	int nbod, sys, flags;
-	const body *bodies;
-	lr >> time >> sys >> flags >> nbod >> bodies;
-
 	body center;
 	const body &star = bodies[0];
 
@@ -143,9 +118,114 @@ body center_of_mass(const body* bodies, const int nbod ){
 		center.x = center.y = center.z = center.vx = center.vy = center.vz = 0.; center.mass = star.mass;
 		break;
 	      };
+	return center;
+}
+
+/*! Centers of the coordinate frames of the bodies of a snapshot
+ *
+ * For Jacobi coordinates the center of body bod is the center of mass of
+ * bodies 0..bod-1. It is taken from running sums of the masses and of the
+ * mass-weighted positions and velocities (in the order center_of_mass adds
+ * them up), so the centers of all bodies take O(nbod).
+ */
+void frame_centers(const body* bodies, const int nbod, body* centers)
+{
+	if(planets_coordinate_system != jacobi)
+	  {
+	    std::fill(centers, centers + nbod, frame_center(bodies, nbod));
+	    return;
+	  }
+
+	body sum;
+	sum.x = sum.y = sum.z = sum.vx = sum.vy = sum.vz = 0.;
+	sum.mass = 0.;
+	centers[0] = bodies[0];
+	for(int bod = 0; bod < nbod; bod++)
+	  {
+	    if(bod > 0)
+	      {
+		body &center = centers[bod];
+		center.mass = sum.mass;
+		center.x = sum.x / sum.mass; center.y = sum.y / sum.mass; center.z = sum.z / sum.mass;
+		center.vx = sum.vx / sum.mass; center.vy = sum.vy / sum.mass; center.vz = sum.vz / sum.mass;
+	      }
+	    const body &b = bodies[bod];
+	    sum.x += b.x*b.mass; sum.y += b.y*b.mass; sum.z += b.z*b.mass;
+	    sum.vx += b.vx*b.mass; sum.vy += b.vy*b.mass; sum.vz += b.vz*b.mass;
+	    sum.mass += b.mass;
+	  }
+}
+
+//! Whether body bod of a snapshot is output (the star has no Keplerian or Jacobi coordinates)
+bool output_body(int bod)
+{
+	return bod > 0 || (!keplerian_output && planets_coordinate_system != jacobi);
+}
+
+/*! Coordinates of the bodies of a snapshot relative to the centers of their frames,
+ * for the bodies in body_range that are output: c[6*bod] ... c[6*bod+5] are x, y, z, vx, vy, vz
+ * or, with Keplerian output, a, e, i, O, w, M (angles in degrees).
+ * The Keplerian elements of all the bodies are computed in one batch.
+ */
+void snapshot_coordinates(std::vector<double> &c, const body* bodies, const int nbod, body_range_t &body_range)
+{
+	std::vector<body> centers(nbod);
+	frame_centers(bodies, nbod, &centers[0]);
+	c.resize(6*nbod);
+
+	if( !keplerian_output )
+	  {
+	    for(int bod = 0; bod < nbod; bod++)
+	      {
+		const body &b = bodies[bod], &center = centers[bod];
+		double *cb = &c[6*bod];
+		cb[0] = b.x - center.x; cb[1] = b.y - center.y; cb[2] = b.z - center.z;
+		cb[3] = b.vx - center.vx; cb[4] = b.vy - center.vy; cb[5] = b.vz - center.vz;
+	      }
+	    return;
+	  }
+
+	// relative state vectors, one array per component (the last is GM)
+	std::vector<double> v(7*nbod), el(6*nbod);
+	std::vector<int> bods;
+	for(int bod = 0; bod < nbod; bod++)
+	  {
+	    if(!body_range.in(bod) || !output_body(bod)) { continue; }
+	    const body &b = bodies[bod], &center = centers[bod];
+	    int n = bods.size();
+	    v[n] = b.x - center.x; v[nbod+n] = b.y - center.y; v[2*nbod+n] = b.z - center.z;
+	    v[3*nbod+n] = b.vx - center.vx; v[4*nbod+n] = b.vy - center.vy; v[5*nbod+n] = b.vz - center.vz;
+	    v[6*nbod+n] = b.mass + (planets_coordinate_system == barycentric ? center.mass - b.mass : center.mass);
+	    bods.push_back(bod);
+	  }
+	if(bods.empty()) { return; }
+
+	calc_keplerian_for_cartesian_batch(bods.size(), &el[0], &el[nbod], &el[2*nbod], &el[3*nbod], &el[4*nbod], &el[5*nbod],
+		&v[0], &v[nbod], &v[2*nbod], &v[3*nbod], &v[4*nbod], &v[5*nbod], &v[6*nbod]);
+
+	const double rad2deg = 180./M_PI;
+	for(int n = 0; n != int(bods.size()); n++)
+	  {
+	    double *cb = &c[6*bods[n]];
+	    cb[0] = el[n]; cb[1] = el[nbod+n];
+	    for(int k = 2; k != 6; k++) { cb[k] = el[k*nbod+n]*rad2deg; }
+	  }
+}
+
+// EVT_SNAPSHOT
+    std::ostream& record_output_1(std::ostream &out, gpulog::logrecord &lr, body_range_t &body_range)
+{
+	double time;
+	int nbod, sys, flags;
+	const body *bodies;
+	lr >> time >> sys >> flags >> nbod >> bodies;
+
+	std::vector<double> coords;
+	snapshot_coordinates(coords, bodies, nbod, body_range);
 
 	if((time<=0.) && false)  // was used for debugging at some point
 	  {
+	    body center = frame_center(bodies, nbod);
 	    if (keplerian_output)
 	      { std::cerr << "# Output in Keplerian coordinates  "; }
 	    else { std::cerr << "# Output in Cartesian coordinates  "; }
@@ -170,37 +250,31 @@ body center_of_mass(const body* bodies, const int nbod ){
 	
 	size_t bufsize = 1000;
 	char buf[bufsize];
+	bool first = true;
 	for(int bod = 0; bod < nbod; bod++)
 	{
 	  if(!body_range.in(bod)) { continue; }
 	  const body &b = bodies[bod];
-	  if(  keplerian_output && (bod==0) ) { continue; }
-	  if(  (planets_coordinate_system==jacobi) && (bod==0) ) { continue; }
-	  if( ( !keplerian_output && (planets_coordinate_system!=jacobi) && (bod> 0) ) ||  
-	      ( !keplerian_output && (planets_coordinate_system==jacobi) && (bod> 1) ) ||  
-	      (  keplerian_output && (bod> 1 ) ) ){ out << "\n"; }
-	  
-	  if( planets_coordinate_system == jacobi )
-	    { center = center_of_mass ( bodies, bod); }
+	  if( !output_body(bod) ) { continue; }
+	  // the bodies are separated by newlines, the caller ends the last line
+	  if( !first ) { out << "\n"; }
+	  first = false;
 	  
-	  if( keplerian_output  && bod > 0) 
+	  const double *c = &coords[6*bod];
+	  // "%10d %lg  %6d %6d  %lg  % 9.5lg % 9.5lg % 9.5lg  % 9.5lg % 9.5lg % 9.5lg  %d" for
+	  // Keplerian output, the coordinates are "%9.5lg" (without the space flag) otherwise
+	  char *p = buf;
+	  p += format_d(p, lr.msgid(), 10); *p++ = ' ';
+	  p += format_g(p, time); *p++ = ' '; *p++ = ' ';
+	  p += format_d(p, sys, 6); *p++ = ' ';
+	  p += format_d(p, bod, 6); *p++ = ' '; *p++ = ' ';
+	  p += format_g(p, b.mass); *p++ = ' '; *p++ = ' ';
+	  for(int k = 0; k != 6; k++)
 	    {
-	      if(planets_coordinate_system==barycentric) center.mass -= b.mass;
-	      keplerian_t orbit = keplerian_for_cartesian( b, center );
-	      if(planets_coordinate_system==barycentric) center.mass += b.mass;
-	      const double rad2deg = 180./M_PI;
-	      snprintf(buf, bufsize, "%10d %lg  %6d %6d  %lg  % 9.5lg % 9.5lg % 9.5lg  % 9.5lg % 9.5lg % 9.5lg  %d", lr.msgid(), time, sys, bod, b.mass, orbit.a, orbit.e , orbit.i*rad2deg, orbit.O*rad2deg, orbit.w *rad2deg, orbit.M*rad2deg, flags);
-	    }
-	  if(!keplerian_output)
-	    {
-	      double x = b.x - center.x;
-	      double y = b.y - center.y;
-	      double z = b.z - center.z;
-	      double vx= b.vx- center.vx;
-	      double vy= b.vy- center.vy;
-	      double vz= b.vz- center.vz;
-	      snprintf(buf, bufsize, "%10d %lg  %6d %6d  %lg  %9.5lg %9.5lg %9.5lg  %9.5lg %9.5lg %9.5lg  %d", lr.msgid(), time, sys, bod, b.mass, x, y, z, vx, vy, vz, flags);
+	      p += format_g(p, c[k], 5, 9, keplerian_output); *p++ = ' ';
+	      if(k == 2 || k == 5) { *p++ = ' '; }
 	    }
+	  format_d(p, flags);
 	  out << buf; //  << "\n";
 	}
 	return out;
@@ -318,17 +392,671 @@ std::ostream& record_output_16(std::ostream &out, gpulog::logrecord &lr, body_ra
 }
 
 
+/*! Append the rows of the record to rows, for the csv, binary and columnar output
+ * 
+ * The bodies and coordinates are the ones output_record prints.
+ */
+void output_rows(std::vector<swarm_export_row> &rows, gpulog::logrecord &lr, const body_range_t &_bod)
+{
+	body_range_t body_range = _bod;
+	swarm_export_row row;
+	row.evt = lr.msgid();
+	row.body = -1; row.flags = 0;
+	row.mass = std::numeric_limits<double>::quiet_NaN();
+	std::fill(row.c, row.c + 6, row.mass);
+
+	// Make sure these stay synced with src/swarm/log/log.hpp
+	switch(row.evt){
+	case 1: // standard system snapshot
+	  {
+	    int nbod;
+	    const body *bodies;
+	    lr >> row.time >> row.sys >> row.flags >> nbod >> bodies;
+	    std::vector<double> coords;
+	    snapshot_coordinates(coords, bodies, nbod, body_range);
+	    for(int bod = 0; bod < nbod; bod++)
+	      {
+		if(!body_range.in(bod) || !output_body(bod)) { continue; }
+		row.body = bod;
+		row.mass = bodies[bod].mass;
+		std::copy(&coords[6*bod], &coords[6*bod] + 6, row.c);
+		rows.push_back(row);
+	      }
+	    return;
+	  }
+	case 2: // data one body upon ejection
+	  {
+	    body b;
+	    lr >> row.time >> row.sys >> b;
+	    if(!body_range.in(b.body_id)) return;
+	    row.body = b.body_id;
+	    row.mass = b.mass;
+	    if( keplerian_output )
+	      {
+		keplerian_t orbit;
+		calc_keplerian_for_cartesian(orbit.a, orbit.e, orbit.i, orbit.O, orbit.w, orbit.M, b.x, b.y, b.z, b.vx, b.vy, b.vz, 1. + b.mass);
+		const double rad2deg = 180./M_PI;
+		row.c[0] = orbit.a; row.c[1] = orbit.e; row.c[2] = orbit.i*rad2deg; row.c[3] = orbit.O*rad2deg; row.c[4] = orbit.w*rad2deg; row.c[5] = orbit.M*rad2deg;
+	      }
+	    else
+	      {
+		row.c[0] = b.x; row.c[1] = b.y; row.c[2] = b.z; row.c[3] = b.vx; row.c[4] = b.vy; row.c[5] = b.vz;
+	      }
+	    break;
+	  }
+	case 11: // star v_z at observation time
+	case 15: // near a transit of planet in front of star
+	case 16: // near an occultation of star in front of planet
+	  lr >> row.time >> row.sys >> row.body;
+	  if(!body_range.in(row.body)) return;
+	  break;
+	default:
+	  get_Tsys(lr, row.time, row.sys);
+	}
+	rows.push_back(row);
+}
+
+//! Names of the coordinates of the rows
+static const char *cartesian[6] = { "x", "y", "z", "vx", "vy", "vz" };
+static const char *keplerian[6] = { "a", "e", "i", "O", "w", "M" };
+
+//! Columns of the binary and columnar output, with offsets in a swarm_export_row
+std::vector<swarm_export_column> export_columns()
+{
+	std::vector<swarm_export_column> cols;
+	cols.push_back(swarm_export_column("time", "<f8", 8, offsetof(swarm_export_row, time)));
+	cols.push_back(swarm_export_column("evt", "<i4", 4, offsetof(swarm_export_row, evt)));
+	cols.push_back(swarm_export_column("sys", "<i4", 4, offsetof(swarm_export_row, sys)));
+	cols.push_back(swarm_export_column("body", "<i4", 4, offsetof(swarm_export_row, body)));
+	cols.push_back(swarm_export_column("flags", "<i4", 4, offsetof(swarm_export_row, flags)));
+	cols.push_back(swarm_export_column("mass", "<f8", 8, offsetof(swarm_export_row, mass)));
+	for(int k = 0; k != 6; k++)
+		cols.push_back(swarm_export_column(keplerian_output ? keplerian[k] : cartesian[k], "<f8", 8, offsetof(swarm_export_row, c) + 8*k));
+	return cols;
+}
+
+//! Records of the result copied out of the log, and their formatted output
+struct output_batch
+{
+	std::vector<char> records;	//!< the records, back to back
+	std::vector<int> bods;		//!< body each record was returned for, or -1
+	std::vector<swarm_export_row> rows;
+	std::string text;
+};
+
+//! Number of records in one output_batch
+static const int OUTPUT_BATCH_SIZE = 1024;
+
+//! Format the records of the batch exactly like execute does on its own
+static void format_batch(output_batch &b, const body_range_t &bod)
+{
+	std::ostringstream out;
+	out.flags(std::cout.flags());
+	out.precision(std::cout.precision());
+
+	b.rows.clear();
+	size_t at = 0;
+	for(size_t i = 0; i != b.bods.size(); i++)
+	{
+		gpulog::logrecord lr(&b.records[at]);
+		at += lr.len();
+		body_range_t bodi = b.bods[i] == -1 ? bod : body_range_t(b.bods[i]);
+		if(output_format == text_format)
+		{
+			output_record(out, lr, bodi);
+			out << "\n";
+		}
+		else
+			output_rows(b.rows, lr, bodi);
+	}
+
+	switch(output_format)
+	{
+	case text_format:
+		b.text = out.str();
+		break;
+	case csv_format:
+		b.text.clear();
+		for(size_t i = 0; i != b.rows.size(); i++)
+		{
+			// "%d,%.17g,%d,%d,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%d\n"
+			const swarm_export_row &r = b.rows[i];
+			char buf[1000], *p = buf;
+			p += format_d(p, r.evt); *p++ = ',';
+			p += format_g(p, r.time, 17); *p++ = ',';
+			p += format_d(p, r.sys); *p++ = ',';
+			p += format_d(p, r.body); *p++ = ',';
+			p += format_g(p, r.mass, 17); *p++ = ',';
+			for(int k = 0; k != 6; k++) { p += format_g(p, r.c[k], 17); *p++ = ','; }
+			p += format_d(p, r.flags); *p++ = '\n';
+			b.text.append(buf, p);
+		}
+		break;
+	case binary_format:
+		b.text.clear();
+		if(!b.rows.empty())
+			b.text.assign((const char *)&b.rows[0], b.rows.size() * sizeof(swarm_export_row));
+		break;
+	case columnar_format:
+		break;
+	}
+}
+
+/*! Writes the rows of a columnar output
+ *
+ * The number of rows is only known at the end, so the columns are spooled
+ * to temporary files and written out after the header by finish().
+ */
+class column_writer
+{
+	std::vector<swarm_export_column> cols;
+	std::vector<FILE *> spool;
+	uint64_t nrows;
+	std::vector<char> buf;
+
+public:
+	column_writer() : cols(export_columns()), spool(cols.size()), nrows(0)
+	{
+		for(size_t k = 0; k != cols.size(); k++)
+			if(!(spool[k] = tmpfile()))
+				ERROR("Cannot create a temporary file for the columnar output");
+	}
+
+	~column_writer()
+	{
+		for(size_t k = 0; k != spool.size(); k++)
+			if(spool[k]) { fclose(spool[k]); }
+	}
+
+	//! Append the rows to the columns
+	void append(const std::vector<swarm_export_row> &rows)
+	{
+		if(rows.empty()) { return; }
+		for(size_t k = 0; k != cols.size(); k++)
+		{
+			size_t size = cols[k].size;
+			buf.resize(rows.size() * size);
+			for(size_t i = 0; i != rows.size(); i++)
+				memcpy(&buf[i * size], (const char *)&rows[i] + cols[k].offset, size);
+			if(fwrite(&buf[0], 1, buf.size(), spool[k]) != buf.size())
+				ERROR("Error writing the columnar output");
+		}
+		nrows += rows.size();
+	}
+
+	//! Write the header and the columns (each aligned to 16 bytes) to out
+	void finish(std::ostream &out)
+	{
+		swarm_export_header hdr("query_columns // Columns of swarm query output", cols.size(), nrows);
+		std::vector<swarm_export_column> entries(cols);
+		uint64_t at = sizeof(hdr) + sizeof(entries[0]) * entries.size();
+		for(size_t k = 0; k != entries.size(); k++)
+		{
+			entries[k].offset = at;
+			at += (nrows * entries[k].size + 15) / 16 * 16;
+		}
+		out.write((const char *)&hdr, sizeof(hdr));
+		out.write((const char *)&entries[0], sizeof(entries[0]) * entries.size());
+
+		const char zeros[16] = { 0 };
+		for(size_t k = 0; k != spool.size(); k++)
+		{
+			rewind(spool[k]);
+			buf.resize(1 << 20);
+			size_t n;
+			while((n = fread(&buf[0], 1, buf.size(), spool[k])) > 0)
+				out.write(&buf[0], n);
+			out.write(zeros, (16 - nrows * entries[k].size % 16) % 16);
+		}
+	}
+};
+
+//! Write the header of the csv and binary output
+static void output_header()
+{
+	if(output_format == csv_format)
+	{
+		std::vector<swarm_export_column> cols = export_columns();
+		std::cout << "evt,time,sys,body,mass";
+		for(int k = 6; k != 12; k++) { std::cout << "," << cols[k].name; }
+		std::cout << ",flags\n";
+	}
+	if(output_format == binary_format)
+	{
+		std::vector<swarm_export_column> cols = export_columns();
+		swarm_export_header hdr("query_rows // Rows of swarm query output", cols.size());
+		std::cout.write((const char *)&hdr, sizeof(hdr));
+		std::cout.write((const char *)&cols[0], sizeof(cols[0]) * cols.size());
+	}
+}
+
+//! Write the records of the result, the rows of a columnar output go to columns
+static void output_result(swarmdb::result &r, const body_range_t &bod, column_writer *columns)
+{
+	// The records are read in batches on this thread, since the result is
+	// sequential and the records it returns may not outlive the next call.
+	// The batches are then formatted in parallel and written out in order.
+	std::vector<output_batch> batches(4 * omp_get_max_threads());
+	gpulog::logrecord lr;
+	bool more = true;
+	while(more)
+	{
+		int n = 0;
+		for(; n < int(batches.size()) && more; n++)
+		{
+			output_batch &b = batches[n];
+			b.records.clear(); b.bods.clear();
+			while(int(b.bods.size()) < OUTPUT_BATCH_SIZE && (more = (lr = r.next())))
+			{
+				b.records.insert(b.records.end(), lr.ptr, lr.ptr + lr.len());
+				// a body query returns a snapshot once for each of its bodies
+				b.bods.push_back(r.bod);
+			}
+		}
+
+		#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < n; i++)
+			format_batch(batches[i], bod);
+
+		for(int i = 0; i != n; i++)
+			if(columns)
+				columns->append(batches[i].rows);
+			else
+				std::cout.write(batches[i].text.data(), batches[i].text.size());
+	}
+}
+
     //    void execute(const std::string &datafile, time_range_t T, sys_range_t sys)
-      void execute(const std::string &datafile, time_range_t T, sys_range_t sys, body_range_t bod)
+      void execute(const std::string &datafile, time_range_t T, sys_range_t sys, body_range_t bod, evt_range_t evt)
 {
 	swarmdb db(datafile);
-	swarmdb::result r = db.query(sys, T);
-		//	swarmdb::result r = db.query(sys, bod, T);
-	gpulog::logrecord lr;
-	while(lr = r.next())
+	bool all_bodies = bod.first == int(MIN) && bod.last == int(MAX);
+	swarmdb::result r = all_bodies ? db.query_events(evt, sys, T) : db.query(sys, bod, T);
+	r.evt = evt;
+
+	std::auto_ptr<column_writer> columns;
+	output_header();
+	if(output_format == columnar_format)
+		columns.reset(new column_writer);
+
+	output_result(r, bod, columns.get());
+
+	if(columns.get())
+		columns->finish(std::cout);
+}
+
+//! Read the position saved by follow and the fingerprint of the data up to there, 0 if there is none
+static uint64_t read_follow_position(const std::string &posfile, uint64_t &fingerprint)
+{
+	uint64_t pos = 0;
+	std::ifstream in(posfile.c_str());
+	if(!(in >> pos)) { pos = 0; }
+	if(!(in >> fingerprint)) { fingerprint = swarm_header::npos; }
+	return pos;
+}
+
+//! Save the position of follow, replacing the file at once
+static void write_follow_position(const std::string &posfile, uint64_t pos, uint64_t fingerprint)
+{
+	std::string tmpfn = posfile + ".tmp";
+	std::ofstream out(tmpfn.c_str());
+	out << pos << " " << fingerprint << "\n";
+	out.close();
+	if(!out || rename(tmpfn.c_str(), posfile.c_str()) != 0)
+	{
+		ERROR("Cannot write position file '" + posfile + "'");
+	}
+}
+
+void follow(const std::string &datafile, const std::string &posfile, time_range_t T, sys_range_t sys, body_range_t bod, evt_range_t evt, double interval)
+{
+	if(output_format == columnar_format)
+	{
+		ERROR("The columnar output cannot be followed, its header is written last");
+	}
+
+	// the header is only written when the log is read from the start
+	uint64_t fingerprint;
+	uint64_t pos = read_follow_position(posfile, fingerprint);
+	if(pos == 0) { output_header(); }
+
+	while(true)
+	{
+		{
+			// the log is mapped again to see the records appended since the
+			// last pass, its zone map and indexes are only extended
+			swarmdb db(datafile);
+			uint64_t end = db.data_end();
+			if(pos > end)
+			{
+				std::cerr << "Log file '" << datafile << "' is shorter than the saved position, reading it from the start\n";
+				pos = 0;
+			}
+			else if(pos != 0 && fingerprint != swarm_header::npos && fingerprint != db.data_fingerprint(pos))
+			{
+				std::cerr << "Log file '" << datafile << "' was written again since the saved position, reading it from the start\n";
+				pos = 0;
+			}
+
+			if(end > pos)
+			{
+				swarmdb::result r = db.scan(sys, T, pos);
+				r.evt = evt;
+				output_result(r, bod, NULL);
+				std::cout.flush();
+
+				pos = end;
+				fingerprint = db.data_fingerprint(pos);
+				write_follow_position(posfile, pos, fingerprint);
+			}
+		}
+
+		usleep(useconds_t(interval * 1e6));
+	}
+}
+
+//! Fields that can be aggregated, as indexes in the values of a row
+enum { FIELD_TIME, FIELD_MASS, FIELD_COORDS, FIELD_PERICENTER = FIELD_COORDS + 6, FIELD_APOCENTER, FIELD_ENERGY, FIELD_ENERGY_ERROR, NUM_FIELDS };
+
+//! Index of a field of the rows in their values
+static int aggregate_field(const std::string &name)
+{
+	if(name == "time") { return FIELD_TIME; }
+	if(name == "mass") { return FIELD_MASS; }
+	if(name == "E")    { return FIELD_ENERGY; }
+	if(name == "dE")   { return FIELD_ENERGY_ERROR; }
+
+	const char **names = keplerian_output ? keplerian : cartesian;
+	for(int k = 0; k != 6; k++)
+	{
+		if(name == names[k]) { return FIELD_COORDS + k; }
+	}
+	if(keplerian_output && name == "q") { return FIELD_PERICENTER; }
+	if(keplerian_output && name == "Q") { return FIELD_APOCENTER; }
+
+	for(int k = 0; k != 6; k++)
+	{
+		if(name == keplerian[k]) { ERROR("Field " + name + " needs the Keplerian output"); }
+	}
+	if(name == "q" || name == "Q") { ERROR("Field " + name + " needs the Keplerian output"); }
+	ERROR("Unknown field " + name);
+}
+
+//! Remove the white space around s
+static std::string trim(const std::string &s)
+{
+	std::string::size_type begin = s.find_first_not_of(" \t"), end = s.find_last_not_of(" \t");
+	return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+}
+
+std::vector<aggregate_t> parse_aggregates(const std::string &spec)
+{
+	static const char *ops[] = { "min", "max", "mean", "first", "last" };
+
+	std::vector<aggregate_t> aggregates;
+	std::string::size_type at = 0;
+	while(at <= spec.size())
+	{
+		std::string::size_type end = std::min(spec.find(',', at), spec.size());
+		std::string item = trim(spec.substr(at, end - at));
+		at = end + 1;
+
+		// op(field)
+		std::string::size_type open = item.find('(');
+		if(open == std::string::npos || item.empty() || item[item.size()-1] != ')')
+		{
+			ERROR("Cannot parse aggregate '" + item + "' (expecting e.g. max(e))");
+		}
+
+		aggregate_t a;
+		std::string op = trim(item.substr(0, open));
+		a.field = trim(item.substr(open + 1, item.size() - open - 2));
+		int k = 0;
+		while(k != 5 && op != ops[k]) { k++; }
+		if(k == 5)
+		{
+			ERROR("Unknown aggregate " + op + " (expecting min, max, mean, first or last)");
+		}
+		a.op = aggregate_op_t(k);
+		aggregates.push_back(a);
+	}
+	return aggregates;
+}
+
+//! Running reductions of the values of one field
+struct field_stats
+{
+	long n;
+	double sum, min, max, first, last;
+
+	field_stats() : n(0), sum(0), min(0), max(0), first(0), last(0) {}
+
+	void add(double v)
+	{
+		if(v != v) { return; }
+		if(n == 0) { first = min = max = v; }
+		last = v;
+		sum += v;
+		min = std::min(min, v);
+		max = std::max(max, v);
+		n++;
+	}
+
+	double get(aggregate_op_t op) const
+	{
+		if(n == 0) { return std::numeric_limits<double>::quiet_NaN(); }
+		switch(op)
+		{
+		case aggregate_min:   return min;
+		case aggregate_max:   return max;
+		case aggregate_mean:  return sum / n;
+		case aggregate_first: return first;
+		default:              return last;
+		}
+	}
+};
+
+//! Reductions of the rows of one group
+struct group_stats
+{
+	int sys, body;
+	long rows;
+	std::vector<field_stats> stats;	//!< one per aggregate
+};
+
+//! Total energy (potential+kinetic) of the bodies of a snapshot, like ensemble::calc_total_energy
+static double total_energy(const body *bodies, const int nbod)
+{
+	double K = 0.0, U = 0.0;
+	for(int i = 0; i < nbod; i++)
+	{
+		const body &b = bodies[i];
+		K += 0.5 * b.mass * (b.vx*b.vx + b.vy*b.vy + b.vz*b.vz);
+		for(int j = 0; j < i; j++)
+		{
+			double dx = b.x - bodies[j].x, dy = b.y - bodies[j].y, dz = b.z - bodies[j].z;
+			U += - b.mass * bodies[j].mass / sqrt(dx*dx + dy*dy + dz*dz);
+		}
+	}
+	return K + U;
+}
+
+//! Reduce the records of one system, read from its range of the sys index in time order
+static void aggregate_system(std::vector<group_stats> &result, const swarmdb &db, const swarmdb::result::index_range &r,
+	const std::vector<int> &fields, group_by_t group_by, const body_range_t &bod, const evt_range_t &_evt)
+{
+	evt_range_t evt = _evt;
+	bool energy = false;
+	for(size_t k = 0; k != fields.size(); k++)
+	{
+		energy = energy || fields[k] == FIELD_ENERGY || fields[k] == FIELD_ENERGY_ERROR;
+	}
+
+	std::map<int, group_stats> groups;
+	std::vector<swarm_export_row> rows;
+	double v[NUM_FIELDS], E0 = std::numeric_limits<double>::quiet_NaN();
+	for(const swarmdb::index_entry *e = r.first; e != r.second; e++)
+	{
+		// system-defined records and other events are not read
+		if(e->evt < 0 || !evt.in(e->evt)) { continue; }
+
+		swarmdb::Pbuffer hold;
+		gpulog::logrecord lr(db.get_record(*e, hold));
+		v[FIELD_ENERGY] = v[FIELD_ENERGY_ERROR] = std::numeric_limits<double>::quiet_NaN();
+		if(energy && lr.msgid() == log::EVT_SNAPSHOT)
+		{
+			gpulog::logrecord l = lr;
+			double T; int sys, flags, nbod;
+			const body *bodies;
+			l >> T >> sys >> flags >> nbod >> bodies;
+			v[FIELD_ENERGY] = total_energy(bodies, nbod);
+			if(E0 != E0) { E0 = v[FIELD_ENERGY]; }
+			v[FIELD_ENERGY_ERROR] = (v[FIELD_ENERGY] - E0) / E0;
+		}
+
+		rows.clear();
+		output_rows(rows, lr, bod);
+		for(size_t i = 0; i != rows.size(); i++)
+		{
+			const swarm_export_row &row = rows[i];
+			if(group_by == group_by_body && row.body < 0) { continue; }
+
+			int key = group_by == group_by_body ? row.body : -1;
+			std::map<int, group_stats>::iterator g = groups.find(key);
+			if(g == groups.end())
+			{
+				group_stats gs;
+				gs.sys = row.sys; gs.body = key; gs.rows = 0;
+				gs.stats.resize(fields.size());
+				g = groups.insert(std::make_pair(key, gs)).first;
+			}
+
+			v[FIELD_TIME] = row.time;
+			v[FIELD_MASS] = row.mass;
+			std::copy(row.c, row.c + 6, v + FIELD_COORDS);
+			v[FIELD_PERICENTER] = row.c[0] * (1 - row.c[1]);
+			v[FIELD_APOCENTER]  = row.c[0] * (1 + row.c[1]);
+
+			g->second.rows++;
+			for(size_t k = 0; k != fields.size(); k++)
+			{
+				g->second.stats[k].add(v[fields[k]]);
+			}
+		}
+	}
+
+	for(std::map<int, group_stats>::const_iterator g = groups.begin(); g != groups.end(); g++)
+	{
+		result.push_back(g->second);
+	}
+}
+
+void aggregate(const std::string &datafile, const std::vector<aggregate_t> &aggregates, group_by_t group_by, time_range_t T, sys_range_t sys, body_range_t bod, evt_range_t evt)
+{
+	if(output_format != text_format && output_format != csv_format)
+	{
+		ERROR("Aggregates can only be output as text or csv");
+	}
+
+	std::vector<int> fields;
+	for(size_t k = 0; k != aggregates.size(); k++)
+	{
+		fields.push_back(aggregate_field(aggregates[k].field));
+	}
+
+	// map: every system is reduced on its own, in parallel
+	swarmdb db(datafile);
+	std::vector<swarmdb::result::index_range> ranges;
+	db.system_ranges(ranges, sys, T);
+
+	std::vector<std::vector<group_stats> > results(ranges.size());
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < (int)ranges.size(); i++)
+	{
+		try
+		{
+			aggregate_system(results[i], db, ranges[i], fields, group_by, bod, evt);
+		}
+		catch(const std::exception &e)
+		{
+			#pragma omp critical(swarm_aggregate)
+			error = e.what();
+		}
+	}
+	if(!error.empty())
+	{
+		ERROR(error);
+	}
+
+	// the groups are output in system (and body) order
+	static const char *opnames[] = { "min", "max", "mean", "first", "last" };
+	const char *sep = output_format == csv_format ? "," : "\t";
+	std::cout << (output_format == csv_format ? "" : "# ") << "sys" << sep;
+	if(group_by == group_by_body) { std::cout << "body" << sep; }
+	std::cout << "rows";
+	for(size_t k = 0; k != aggregates.size(); k++)
+	{
+		std::cout << sep << opnames[aggregates[k].op] << "(" << aggregates[k].field << ")";
+	}
+	std::cout << "\n";
+
+	for(size_t i = 0; i != results.size(); i++)
+	{
+		for(size_t j = 0; j != results[i].size(); j++)
+		{
+			const group_stats &g = results[i][j];
+			std::cout << g.sys << sep;
+			if(group_by == group_by_body) { std::cout << g.body << sep; }
+			std::cout << g.rows;
+			for(size_t k = 0; k != aggregates.size(); k++)
+			{
+				double x = g.stats[k].get(aggregates[k].op);
+				if(output_format == csv_format)
+				{
+					char buf[32];
+					std::cout << sep << std::string(buf, format_g(buf, x, 17));
+				}
+				else
+					std::cout << sep << x;
+			}
+			std::cout << "\n";
+		}
+	}
+}
+
+void count(const std::string &datafile, bool per_system, time_range_t T, sys_range_t sys, evt_range_t evt)
+{
+	if(output_format != text_format && output_format != csv_format)
+	{
+		ERROR("Counts can only be output as text or csv");
+	}
+
+	swarmdb db(datafile);
+	std::vector<swarmdb::count_t> counts;
+	if(per_system)
+		db.count_systems(counts, sys, T, evt);
+	else
+		counts.push_back(db.count(sys, T, evt));
+
+	const char *sep = output_format == csv_format ? "," : "\t";
+	std::cout << (output_format == csv_format ? "" : "# ");
+	if(per_system) { std::cout << "sys" << sep; }
+	std::cout << "records" << sep << "Tmin" << sep << "Tmax\n";
+	for(size_t i = 0; i != counts.size(); i++)
 	{
-	  output_record(std::cout, lr,bod );
-		std::cout << "\n";
+		const swarmdb::count_t &c = counts[i];
+		if(per_system) { std::cout << c.sys << sep; }
+		std::cout << c.n;
+		if(output_format == csv_format)
+		{
+			char buf[64], *p = buf;
+			*p++ = ','; p += format_g(p, c.Tmin, 17);
+			*p++ = ','; p += format_g(p, c.Tmax, 17);
+			std::cout << std::string(buf, p) << "\n";
+		}
+		else
+			std::cout << sep << c.Tmin << sep << c.Tmax << "\n";
 	}
 }
 
@@ -121,9 +121,35 @@ std::ostream &output_record(std::ostream &out, gpulog::logrecord &lr, const body
  * @param T        Range of times to output
  * @param sys      Range of systems to output
  * @param bod      Range of bodies to output
+ * @param evt      Range of event ids to output
  * 
+ * If bod is not ALL, the body index is used and the records are output by
+ * body, system and time. Records that are not about a body are left out.
+ * Otherwise, if evt is not ALL, the event index is used and the records are
+ * output by event id and time.
+ *
+ * The records are formatted by all OpenMP threads, in batches that are
+ * written out in the order of the query. The format of the output is set
+ * with @ref set_output_format.
  */
-void execute(const std::string &datafile, time_range_t T, sys_range_t sys, body_range_t bod = body_range_t() );
+void execute(const std::string &datafile, time_range_t T, sys_range_t sys, body_range_t bod = body_range_t(), evt_range_t evt = evt_range_t() );
+
+/*! Follow a log file that is still being written, like tail -f. The records
+ * that match the ranges are output in log order as they are appended to the
+ * log, until the process is stopped.
+ *
+ * @param datafile Filename for the swarm binary log (or manifest) to follow
+ * @param posfile  File that keeps the offset up to which the log has been output,
+ *                 so a restarted follow continues from there
+ * @param interval Seconds to wait before looking for new records again
+ *
+ * The log is mapped again on every pass and only the records past the saved
+ * offset are read. A record that is still being written is output on the next
+ * pass. A log that was written again since the saved offset is read from the
+ * start. The csv and binary headers are only written when following starts at
+ * the beginning of the log, the columnar format cannot be followed.
+ */
+void follow(const std::string &datafile, const std::string &posfile, time_range_t T, sys_range_t sys, body_range_t bod = body_range_t(), evt_range_t evt = evt_range_t(), double interval = 1 );
 
 enum planets_coordinate_system_t {
   astrocentric, barycentric, jacobi, origin
@@ -139,6 +165,69 @@ void set_keplerian_output(const planets_coordinate_system_t& coordinate_system =
  */
 void set_coordinate_system(const planets_coordinate_system_t& coordinate_system);  
 
+/*! Formats of the output of @ref execute
+ *
+ * text_format is the pretty printed records. The other formats have one row
+ * per body of a snapshot or ejection and per other event (c.f. swarm_export_row):
+ * csv_format is comma-separated text with a header line, binary_format is a
+ * swarm_export_header followed by the rows and columnar_format is a
+ * swarm_export_header followed by an array for each column.
+ */
+enum output_format_t {
+  text_format, csv_format, binary_format, columnar_format
+};
+
+//! Set the output format of the @ref execute
+void set_output_format(const output_format_t& format);
+
+//! Reductions of @ref aggregate
+enum aggregate_op_t {
+  aggregate_min, aggregate_max, aggregate_mean, aggregate_first, aggregate_last
+};
+
+/*! A reduction of one field of the rows of a group, e.g. max(e).
+ *
+ * The fields are time, mass, the six coordinates of the output (x, y, z, vx,
+ * vy, vz or, with the Keplerian output, a, e, i, O, w, M), the pericentre and
+ * apocentre distances q and Q (Keplerian output only), the total energy E of
+ * the system of a snapshot and its relative change dE since the first
+ * snapshot of the system in the time range.
+ */
+struct aggregate_t {
+  aggregate_op_t op;
+  std::string field;
+};
+
+//! Parse a comma-separated list of reductions, e.g. "max(e),min(q),first(time)"
+std::vector<aggregate_t> parse_aggregates(const std::string &spec);
+
+//! Groups of @ref aggregate
+enum group_by_t {
+  group_by_system, group_by_body
+};
+
+/*! Reduce the records of a query per system or per body of each system, and
+ * output one line per group with the number of rows and the reductions.
+ *
+ * The rows are the ones of the csv output (c.f. output_format_t), so the
+ * coordinates follow the coordinate system set for the output. Values that a
+ * row does not have (NaN) are left out of the reductions, first and last
+ * are the values of the earliest and latest row that has one. When grouping
+ * by body, the rows that are not about a body are left out.
+ *
+ * The systems are reduced in parallel, each over the range of the system
+ * index that holds its records, and the records of other event ids are
+ * skipped without reading them. The output format can be text or csv.
+ */
+void aggregate(const std::string &datafile, const std::vector<aggregate_t> &aggregates, group_by_t group_by, time_range_t T, sys_range_t sys, body_range_t bod = body_range_t(), evt_range_t evt = evt_range_t() );
+
+/*! Output the number of records of a query and the time of the first and
+ * the last one, for all of them or per system (group_by_system). They are
+ * answered from the zone map and the indexes with swarmdb::count, without
+ * reading the records. The output format can be text or csv.
+ */
+void count(const std::string &datafile, bool per_system, time_range_t T, sys_range_t sys, evt_range_t evt = evt_range_t() );
+
 } }
 
 
@@ -23,6 +23,7 @@
 */
 
 #include "snapshot.hpp"
+#include "format.hpp"
 
 namespace swarm {
 
@@ -185,31 +186,37 @@ void save_text(defaultEnsemble& ens, const string& filename)  throw (writefileex
 	fprintf(f, "%s %i\n" , DEFAULT_IO_TAG, CURRENT_IO_VERSION );
 	fprintf(f,"%i %i %i %i\n\n\n", ens.nbod(), ens.nsys(), ensemble::NUM_SYS_ATTRIBUTES, ensemble::NUM_BODY_ATTRIBUTES );
 
+	// The values are written with format_e, which is "%.15le" without the
+	// cost of printf
+	std::vector<char> buf(64 * (3 + ensemble::NUM_SYS_ATTRIBUTES + ens.nbod() * (7 + ensemble::NUM_BODY_ATTRIBUTES)));
 	for(int i = 0; i < ens.nsys(); i++){
 
 		ensemble::SystemRef sr = ens[i];
-		fprintf(f,"%i %.15le %i\n", sr.id(), sr.time(), sr.state()); 
+		char *p = &buf[0];
+		p += format_d(p, sr.id()); *p++ = ' ';
+		p += format_e(p, sr.time(), 15); *p++ = ' ';
+		p += format_d(p, sr.state()); *p++ = '\n';
 
 		for(int l = 0; l < ensemble::NUM_SYS_ATTRIBUTES; l++)
-			fprintf(f,"%.15le ", sr.attribute(l));
-		fprintf(f, "\n");
+			{ p += format_e(p, sr.attribute(l), 15); *p++ = ' '; }
+		*p++ = '\n';
 
 		for(int j = 0; j < ens.nbod(); j++){
-			fprintf(f,"\t%.15le\n\t%.15le %.15le %.15le\n\t%.15le %.15le %.15le\n\t",
-					sr[j].mass(),
-					sr[j][0].pos(),
-					sr[j][1].pos(),
-					sr[j][2].pos(),
-					sr[j][0].vel(),
-					sr[j][1].vel(),
-					sr[j][2].vel()
-				   );
+			// "\t%.15le\n\t%.15le %.15le %.15le\n\t%.15le %.15le %.15le\n\t"
+			*p++ = '\t'; p += format_e(p, sr[j].mass(), 15); *p++ = '\n';
+			for(int c = 0; c < 3; c++)
+				{ *p++ = c == 0 ? '\t' : ' '; p += format_e(p, sr[j][c].pos(), 15); }
+			*p++ = '\n';
+			for(int c = 0; c < 3; c++)
+				{ *p++ = c == 0 ? '\t' : ' '; p += format_e(p, sr[j][c].vel(), 15); }
+			*p++ = '\n'; *p++ = '\t';
 			for(int l = 0; l < ensemble::NUM_BODY_ATTRIBUTES; l++)
-				fprintf(f,"%.15le ", sr[j].attribute(l));
-			fprintf(f, "\n\n");
+				{ p += format_e(p, sr[j].attribute(l), 15); *p++ = ' '; }
+			*p++ = '\n'; *p++ = '\n';
 		}
 
-		fprintf(f,"\n");
+		*p++ = '\n';
+		fwrite(&buf[0], 1, p - &buf[0], f);
 
 	}
 	fclose(f);
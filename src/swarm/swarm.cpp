@@ -471,11 +471,18 @@ void parse_commandline_and_config(int argc, char* argv[]){
 		("time,t", po::value<query::time_range_t>(), "range of times to query")
 		("system,s", po::value<query::sys_range_t>(), "range of systems to query")
 		("body,b", po::value<query::sys_range_t>(), "range of bodies to query")
+		("event,e", po::value<query::evt_range_t>(), "range of event ids to query (e.g. 2 for ejections)")
 		("keplerian,k", "output in Keplerian coordinates")
 		("astrocentric", "output coordinates in astrocentric frame")
 		("barycentric", "output coordinates in barycentric frame")
 		("origin", "output coordinates in origin frame [default w/ Cartesian]")
 		("jacobi", "output coordinates in Jacobi frame [default w/ Keplerian]")
+		("format", po::value<std::string>(), "output format: text, csv, binary or columnar")
+		("follow", "keep reading the records appended to the log file, like tail -f")
+		("follow-position", po::value<std::string>(), "file that keeps the position of --follow across restarts [default: <logfile>.follow]")
+		("aggregate", po::value<std::string>(), "output reductions per system instead of the records, e.g. max(e),min(q),first(time)")
+		("count", "output the number of records and their time range instead of the records, from the indexes")
+		("group-by", po::value<std::string>(), "groups of --aggregate (system or body) and --count (system) [default: system for --aggregate, none for --count]")
 		("logfile,f", po::value<std::string>(), "the log file to query");
 
 	po::options_description positional("Positional Options");
@@ -605,18 +612,28 @@ int main(int argc, char* argv[]){
 
 		time_range_t T;
 		sys_range_t sys, body_range;
+		evt_range_t evt;
 		if (argvars_map.count("time")) { T = argvars_map["time"].as<time_range_t>(); }
 		if (argvars_map.count("system")) { sys = argvars_map["system"].as<sys_range_t>(); }
 		if (argvars_map.count("body")) { body_range = argvars_map["body"].as<sys_range_t>(); }
+		if (argvars_map.count("event")) { evt = argvars_map["event"].as<evt_range_t>(); }
 		if (argvars_map.count("keplerian")) { query::set_keplerian_output(); }
 		if (argvars_map.count("origin")) { query::set_coordinate_system(query::origin); }
 		if (argvars_map.count("astrocentric")) { query::set_coordinate_system(query::astrocentric); }
 		if (argvars_map.count("barycentric")) { query::set_coordinate_system(query::barycentric); }
 		if (argvars_map.count("jacobi")) { query::set_coordinate_system(query::jacobi); }
+		if (argvars_map.count("format")) {
+			std::string format = argvars_map["format"].as<std::string>();
+			if (format == "text") { query::set_output_format(query::text_format); }
+			else if (format == "csv") { query::set_output_format(query::csv_format); }
+			else if (format == "binary") { query::set_output_format(query::binary_format); }
+			else if (format == "columnar") { query::set_output_format(query::columnar_format); }
+			else { cerr << "Unknown output format " << format << " (expecting text, csv, binary or columnar)\n"; return 1; }
+		}
 
 
         std::cout.flush(); 
-	cerr << "# Systems: " << sys << " Bodies: " << body_range << " Times: " << T << endl;
+	cerr << "# Systems: " << sys << " Bodies: " << body_range << " Times: " << T << " Events: " << evt << endl;
 	if (argvars_map.count("keplerian")) 
 	  { std::cerr << "# Output in Keplerian coordinates  "; }
 	else { std::cerr << "# Output in Cartesian coordinates  "; }
@@ -642,7 +659,33 @@ int main(int argc, char* argv[]){
 
 		std::string datafile(argvars_map["logfile"].as<std::string>());
 
-		query::execute(datafile, T, sys, body_range);
+		if (argvars_map.count("aggregate")) {
+			query::group_by_t group_by = query::group_by_system;
+			if (argvars_map.count("group-by")) {
+				std::string group = argvars_map["group-by"].as<std::string>();
+				if (group == "system") { group_by = query::group_by_system; }
+				else if (group == "body") { group_by = query::group_by_body; }
+				else { cerr << "Unknown group " << group << " (expecting system or body)\n"; return 1; }
+			}
+			query::aggregate(datafile, query::parse_aggregates(argvars_map["aggregate"].as<std::string>()), group_by, T, sys, body_range, evt);
+		}
+		else if (argvars_map.count("count")) {
+			bool per_system = false;
+			if (argvars_map.count("group-by")) {
+				std::string group = argvars_map["group-by"].as<std::string>();
+				if (group == "system") { per_system = true; }
+				else { cerr << "Unknown group " << group << " for --count (expecting system)\n"; return 1; }
+			}
+			if (argvars_map.count("body")) { cerr << "Records cannot be counted by body\n"; return 1; }
+			query::count(datafile, per_system, T, sys, evt);
+		}
+		else if (argvars_map.count("follow")) {
+			std::string posfile = datafile + ".follow";
+			if (argvars_map.count("follow-position")) { posfile = argvars_map["follow-position"].as<std::string>(); }
+			query::follow(datafile, posfile, T, sys, body_range, evt);
+		}
+		else
+			query::execute(datafile, T, sys, body_range, evt);
 	}
 
 	else if(command == "generate" ) {
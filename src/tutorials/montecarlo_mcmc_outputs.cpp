@@ -736,25 +736,18 @@ int main(int argc, char* argv[] )
 
 #if ACCESS_HOST_ARRAY_OF_TRANSIT_TIMES
 
-  static const int max_num_doubles_per_event = 2;
-  typedef swarm::event_record<max_num_doubles_per_event> event_record_type;
-  typedef std::vector<event_record_type>  event_log_one_system_type;
-  typedef std::vector<event_log_one_system_type>  event_log_one_code_type;
-  std::vector<event_log_one_code_type> event_log;
-
-  event_log_one_code_type data = (static_cast<host_array_writer* >(swarm::log::manager::default_log()->get_writer().get()))->get_event_log_all_systems(0);
+  swarm::log::event_table& data = (static_cast<swarm::log::host_array_writer* >(swarm::log::manager::default_log()->get_writer().get()))->get_event_log(0);
   std::vector<std::vector<std::vector<double> > > transit_times_model(ens_init.nsys(), std::vector<std::vector<double> >(ens_init.nbod()));
   std::vector<std::vector<std::vector<double> > > transit_durations_model(ens_init.nsys(), std::vector<std::vector<double> >(ens_init.nbod()));
 
-  for(int sysid=0;sysid<data.size();++sysid)
+  for(int sysid=0;sysid<data.nsys();++sysid)
     {
-      for(int e=0;e<data[sysid].size();++e)
+      for(size_t e=data.begin(sysid);e<data.end(sysid);++e)
 	{
-	  event_record_type er = data[sysid][e];
-	  int bodid = er.bodid1;
-	  double time = er.time;
-	  double b = er.data[0];
-	  double vproj = er.data[1];
+	  int bodid = data.bodid1(e);
+	  double time = data.time(e);
+	  double b = data.data(e)[0];
+	  double vproj = data.data(e)[1];
 	  transit_times_model[sysid][bodid].push_back(time);
 	  transit_durations_model[sysid][bodid].push_back(sqrt(1.-b*b)/vproj);
 	}
@@ -27,10 +27,9 @@
 #include <boost/program_options/positional_options.hpp>
 
 #include <iostream>
-#include <db_cxx.h>
-
 #include "swarm/swarm.h"
 #include "swarm/query.hpp"
+#include "swarm/log/bdb_common.hpp"
 #include "binary_reader.hpp"
 
 using namespace swarm;
@@ -42,6 +41,7 @@ using boost::shared_ptr;
 using gpulog::logrecord;
 
 int recordsLimit = 1000;
+int batchSize = 4*1024*1024;
 int DEBUG_LEVEL = 0;
 
 po::variables_map argvars_map;
@@ -54,6 +54,7 @@ void parse_commandline_and_config(int argc, char* argv[]){
 			("input,i", po::value<std::string>(), "Binary log file from swarm binary_writer")
 			("output,o", po::value<std::string>(), "Name of the database output file")
 			("number,n", po::value<int>(), "Number of records to convert")
+			("batch,b", po::value<int>(), "Size in bytes of the batches written to the database")
 			("verbose,v", po::value<int>(), "Verbosity level")
 			("dump,d", "Dump all the records up to the number")
 			("quiet,q", "Suppress all messages")
@@ -90,88 +91,10 @@ void parse_commandline_and_config(int argc, char* argv[]){
 	if(vm.count("number"))
 		recordsLimit = vm["number"].as<int>();
 
+	if(vm.count("batch"))
+		batchSize = vm["batch"].as<int>();
 
-}
-
-
-template<typename T>
-void put_in_dbt(const T& t, Dbt* data){
-	data->set_flags(DB_DBT_APPMALLOC);
-	data->set_size(sizeof(T));
-	data->set_data(new T(t));
-}
-
-
-bool extract_from_ptr(void* ptr, size_t size, double& time, int& sys){
-	logrecord l((char*)ptr);
-	assert(l.len() == size);
-
-	// Based on the implementation in query.cpp
-	switch(l.msgid()){
-	case 1: case 2: case 11: case 15: case 16:
-		l >> time >> sys;
-		return true;
-
-	default:
-		return false;
-	}
-
-}
-
-/**
- * Extract the system ID from a log record
- *
- * @param secondary: The secondary parameter is the database handle for the secondary.
- * @param key      : The key parameter is a Dbt referencing the primary key.
- * @param data     : The data parameter is a Dbt referencing the primary data item.
- * @param result   : The result parameter is a zeroed Dbt in which the callback function
- *                   should fill in data and size fields that describe the secondary key or keys.
- */
-int lr_extract_sysid(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
-	double time = -1; int sys = -1;
-
-	if(extract_from_ptr(data->get_data(), data->get_size(), time, sys)){
-		put_in_dbt(sys, result);
-		return 0;
-	} else
-		return DB_DONOTINDEX;
-}
-
-int lr_extract_evtid(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
-	logrecord l((char*)data->get_data());
-	assert(l.len() == data->get_size());
-
-	put_in_dbt(l.msgid(), result);
-
-	return 0;
-}
-
-int lr_extract_time(Db *secondary, const Dbt *key, const Dbt *data, Dbt *result) {
-	double time = -1; int sys = -1;
-
-	if(extract_from_ptr(data->get_data(), data->get_size(), time, sys)){
-		put_in_dbt(time, result);
-		return 0;
-	} else
-		return DB_DONOTINDEX;
-}
 
-int compare_time(DB* db, const DBT *k1, const DBT* k2){
-    if(k1->size < k2->size)
-        return -1;
-    else if(k1->size > k2->size)
-        return 1;
-    else{
-        if( (k1->size == 8) && (k2->size == 8) ) {
-            double& a = *(double*)(k1->data);
-            double& b = *(double*)(k2->data);
-            if(a < b) return -1;
-            else if(a > b) return 1;
-            else return 0;
-        }else{
-            return 0;
-        }
-    }
 }
 
 
@@ -221,43 +144,33 @@ int main(int argc, char* argv[]){
 	dbenv.open(".",  DB_CREATE | DB_INIT_LOG |
             DB_INIT_LOCK | DB_INIT_MPOOL |
             DB_INIT_TXN , 0);*/
-	Db primary(NULL, 0), system_idx(NULL, 0), time_idx(NULL, 0), event_idx(NULL, 0);
+	Db primary(NULL, 0);
 	primary.open(NULL, (outputFileName+".p.db").c_str(), NULL, DB_BTREE, DB_CREATE, 0);
-	system_idx.set_flags(DB_DUP | DB_DUPSORT);
-	system_idx.open(NULL, (outputFileName+".sys.db").c_str(), NULL, DB_BTREE, DB_CREATE , 0);
-	time_idx.set_flags(DB_DUP | DB_DUPSORT);
-    time_idx.set_bt_compare(compare_time);
-	time_idx.open(NULL, (outputFileName+".time.db").c_str(), NULL, DB_BTREE, DB_CREATE  , 0);
-	event_idx.set_flags(DB_DUP | DB_DUPSORT);
-	event_idx.open(NULL, (outputFileName+".evt.db").c_str(), NULL, DB_BTREE, DB_CREATE , 0);
-
-	primary.associate(NULL, &system_idx,  &lr_extract_sysid, DB_IMMUTABLE_KEY);
-	primary.associate(NULL, &time_idx  ,  &lr_extract_time , DB_IMMUTABLE_KEY);
-	primary.associate(NULL, &event_idx ,  &lr_extract_evtid, DB_IMMUTABLE_KEY);
 
+	{
+		// Records are written in batches with bulk puts
+		swarm::log::bdb::bulk_loader loader(primary, batchSize);
 
+		for(int i=0; i < recordsLimit && input_reader.has_next(); i++) {
+			// read one record from binary file
+			logrecord l = input_reader.next();
 
-	for(int i=0; i < recordsLimit && input_reader.has_next(); i++) {
-		// read one record from binary file
-		logrecord l = input_reader.next();
+			if(argvars_map.count("dump") > 0) {
+				output_record(std::cout, l);
+				std::cout << std::endl;
+			}
 
-		if(argvars_map.count("dump") > 0) {
-			output_record(std::cout, l);
-			std::cout << std::endl;
+			// insert it into the primary database
+			loader.put(i, l.ptr, l.len());
 		}
-
-		// insert it into the primary database, the secondary indices are automatically populated.
-		Dbt key(&i,sizeof(int));
-		Dbt data((void*)l.ptr,l.len());
-		primary.put(NULL,&key,&data,0);
-
 	}
 
+	// The secondary indices are built in one pass after loading instead of
+	// being updated on every put
+	swarm::log::bdb::build_secondary_indexes(primary, outputFileName);
+
 	// Close all the databases
 	primary.close(0);
-	system_idx.close(0);
-	time_idx.close(0);
-	event_idx.close(0);
 	//dbenv.close(0);
 
 	// Close the binary file
@@ -0,0 +1,185 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file keplerian_batch.cpp
+ *    \brief Tests calc_keplerian_for_cartesian_batch against calc_keplerian_for_cartesian.
+ *
+ *  The batch conversion has to give the same bits as the scalar one for bound,
+ *  unbound and parabolic orbits. The parabolic orbits are also checked against
+ *  their elements, with the mean anomaly from Barker's equation.
+ *
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "swarm/common.hpp"
+#include "swarm/kepler.h"
+#include <cstring>
+
+//! Deterministic uniform numbers in [0,1), the same on every platform
+static double uniform()
+{
+	static unsigned long long s = 88172645463325252ULL;
+	s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+	return (s >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//! A set of relative state vectors in the layout calc_keplerian_for_cartesian_batch takes
+struct state_vectors {
+	std::vector<double> x, y, z, vx, vy, vz, GM;
+	void add(double px, double py, double pz, double pvx, double pvy, double pvz, double pGM)
+	{
+		x.push_back(px); y.push_back(py); z.push_back(pz);
+		vx.push_back(pvx); vy.push_back(pvy); vz.push_back(pvz); GM.push_back(pGM);
+	}
+	int size() const { return x.size(); }
+};
+
+//! Rotate v from the orbital plane by w about z, i about x, then O about z
+static void rotate(double v[3], double i, double O, double w)
+{
+	double x = v[0]*cos(w) - v[1]*sin(w), y = v[0]*sin(w) + v[1]*cos(w);
+	double z = y*sin(i);
+	y = y*cos(i);
+	v[0] = x*cos(O) - y*sin(O); v[1] = x*sin(O) + y*cos(O); v[2] = z;
+}
+
+//! State vector of a parabolic orbit with perihelion distance q at true anomaly nu
+static void add_parabola(state_vectors &s, double q, double i, double O, double w, double nu, double GM)
+{
+	double p = 2.*q, r = p/(1.+cos(nu)), vfac = sqrt(GM/p);
+	double pos[3] = { r*cos(nu), r*sin(nu), 0. };
+	double vel[3] = { -vfac*sin(nu), vfac*(1.+cos(nu)), 0. };
+	rotate(pos, i, O, w); rotate(vel, i, O, w);
+	s.add(pos[0], pos[1], pos[2], vel[0], vel[1], vel[2], GM);
+}
+
+//! Bit for bit comparison of the batch and the scalar conversion of all of s
+static int compare_batch(const state_vectors &s, const char *name)
+{
+	const int n = s.size();
+	std::vector<double> a(n), e(n), i(n), O(n), w(n), M(n);
+	calc_keplerian_for_cartesian_batch(n, &a[0], &e[0], &i[0], &O[0], &w[0], &M[0],
+		&s.x[0], &s.y[0], &s.z[0], &s.vx[0], &s.vy[0], &s.vz[0], &s.GM[0]);
+
+	int failed = 0;
+	for(int k = 0; k < n; k++)
+	{
+		double el[6];
+		calc_keplerian_for_cartesian(el[0], el[1], el[2], el[3], el[4], el[5],
+			s.x[k], s.y[k], s.z[k], s.vx[k], s.vy[k], s.vz[k], s.GM[k]);
+		const double bel[6] = { a[k], e[k], i[k], O[k], w[k], M[k] };
+		if(memcmp(el, bel, sizeof(el)) != 0)
+		{
+			if(failed++ < 10)
+				fprintf(stderr, "%s %d: batch (%.17g %.17g %.17g %.17g %.17g %.17g) != scalar (%.17g %.17g %.17g %.17g %.17g %.17g)\n",
+					name, k, bel[0], bel[1], bel[2], bel[3], bel[4], bel[5], el[0], el[1], el[2], el[3], el[4], el[5]);
+		}
+	}
+	printf("%s: %d orbits, %d differ\n", name, n, failed);
+	return failed;
+}
+
+//! Angle in (-pi, pi], as calc_keplerian_for_cartesian returns the argument of pericenter
+static double wrap(double w)
+{
+	w = fmod(w, 2.*M_PI);
+	if(w > M_PI) w -= 2.*M_PI;
+	if(w <= -M_PI) w += 2.*M_PI;
+	return w;
+}
+
+static bool close(double v, double expected)
+{
+	return fabs(v - expected) <= 1e-10 * (1. + fabs(expected));
+}
+
+//! Elements of parabolic orbits against the ones they were made from
+static int check_parabolas()
+{
+	struct { double q, i, O, w, nu; } orbits[] = {
+		{ 1.0, 0.0, 0.0, 0.0, 0.5 },
+		{ 1.0, 0.0, 0.0, 0.0, -0.5 },
+		{ 2.5, 0.5, 0.7, 0.9, 1.0 },
+		{ 2.5, 0.5, 0.7, 0.9, -1.0 },
+		{ 0.3, 2.0, 4.0, -2.5, 2.5 },
+		{ 0.3, 2.0, 4.0, -2.5, -2.5 },
+	};
+	const int n = sizeof(orbits)/sizeof(orbits[0]);
+
+	int failed = 0;
+	for(int k = 0; k < n; k++)
+	{
+		state_vectors s;
+		add_parabola(s, orbits[k].q, orbits[k].i, orbits[k].O, orbits[k].w, orbits[k].nu, 1.);
+		double a, e, i, O, w, M;
+		calc_keplerian_for_cartesian(a, e, i, O, w, M, s.x[0], s.y[0], s.z[0], s.vx[0], s.vy[0], s.vz[0], s.GM[0]);
+
+		// Barker's equation, the mean anomaly of a parabolic orbit
+		double t = tan(0.5*orbits[k].nu);
+		double expected_M = t*(1.+t*t/3.);
+		// an equatorial orbit has no node, its argument of pericenter is measured from x
+		double expected_O = orbits[k].i == 0. ? 0. : orbits[k].O;
+
+		if( e != 1. || !close(a, orbits[k].q) || !close(i, orbits[k].i) || !close(O, expected_O)
+			|| !close(wrap(w), wrap(orbits[k].w)) || !close(M, expected_M) )
+		{
+			fprintf(stderr, "parabola %d: got a=%.17g e=%.17g i=%.17g O=%.17g w=%.17g M=%.17g, expected M=%.17g\n",
+				k, a, e, i, O, w, M, expected_M);
+			failed++;
+		}
+	}
+	printf("parabolic elements: %d orbits, %d wrong\n", n, failed);
+	return failed;
+}
+
+int main()
+{
+	// the sizes are not multiples of the chunk size of the batch conversion
+	state_vectors bound, unbound, parabolic, mixed;
+	for(int k = 0; k < 1001; k++)
+	{
+		double a = 0.1 + 10.*uniform(), e = k % 10 == 0 ? 0. : 0.99*uniform();
+		double i = k % 7 == 0 ? 0. : M_PI*uniform(), O = 2.*M_PI*uniform(), w = 2.*M_PI*uniform(), M = 2.*M_PI*uniform();
+		double GM = 0.5 + uniform(), x, y, z, vx, vy, vz;
+		calc_cartesian_for_ellipse(x, y, z, vx, vy, vz, a, e, i, O, w, M, GM);
+		bound.add(x, y, z, vx, vy, vz, GM);
+		mixed.add(x, y, z, vx, vy, vz, GM);
+	}
+	for(int k = 0; k < 1001; k++)
+	{
+		double x = 10.*uniform()-5., y = 10.*uniform()-5., z = k % 7 == 0 ? 0. : 10.*uniform()-5.;
+		double GM = 0.5 + uniform(), r = sqrt(x*x+y*y+z*z);
+		// faster than the escape velocity in a random direction
+		double v = sqrt(2.*GM/r)*(1.01 + 3.*uniform());
+		double dx = uniform()-0.5, dy = uniform()-0.5, dz = k % 7 == 0 ? 0. : uniform()-0.5;
+		double d = sqrt(dx*dx+dy*dy+dz*dz);
+		unbound.add(x, y, z, v*dx/d, v*dy/d, v*dz/d, GM);
+		mixed.add(x, y, z, v*dx/d, v*dy/d, v*dz/d, GM);
+	}
+	for(int k = 0; k < 101; k++)
+	{
+		double nu = (2.*uniform()-1.)*0.95*M_PI;
+		add_parabola(parabolic, 0.1 + 5.*uniform(), M_PI*uniform(), 2.*M_PI*uniform(), 2.*M_PI*uniform(), nu, 0.5 + uniform());
+		add_parabola(mixed, 0.1 + 5.*uniform(), M_PI*uniform(), 2.*M_PI*uniform(), 2.*M_PI*uniform(), nu, 0.5 + uniform());
+	}
+
+	int failed = compare_batch(bound, "bound") + compare_batch(unbound, "unbound")
+		+ compare_batch(parabolic, "parabolic") + compare_batch(mixed, "mixed")
+		+ check_parabolas();
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file index.cpp
+ *    \brief Tests that the indexes extended after the log grew answer like rebuilt ones.
+ *
+ *  A log is written in full, then copied piece by piece to a second file,
+ *  cutting through records. The second file is queried after each piece,
+ *  so its zone map and indexes are extended with the records appended since
+ *  the last query. After the last piece they must give the same results as
+ *  the indexes of the full log, which are built at once. A log that is
+ *  written again in place, larger than before, must have its indexes
+ *  rebuilt.
+ *
+ *  Usage: index <prefix>, the logs are written to <prefix>.<name>.raw.
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "logs.hpp"
+#include <fstream>
+#include <iterator>
+
+using namespace swarm;
+using namespace swarm::query;
+
+//! The records of a body query, each as its bytes followed by the body it was returned for
+static void read_body_records(std::vector<std::string> &recs, swarmdb::result r)
+{
+	recs.clear();
+	gpulog::logrecord lr;
+	while(lr = r.next())
+	{
+		recs.push_back(std::string(lr.ptr, lr.len()));
+		recs.back().append((const char *)&r.bod, sizeof(r.bod));
+	}
+}
+
+//! Compare the grown log fn with the log ref, whose indexes are built from scratch
+static int compare_indexes(const std::string &fn, const std::string &ref)
+{
+	swarmdb db(fn), dbref(ref);
+	std::vector<std::string> a, b;
+	int failed = 0;
+
+	read_body_records(a, db.query(sys_range_t(2, 6), body_range_t(1, 2), time_range_t(3., 12.)));
+	read_body_records(b, dbref.query(sys_range_t(2, 6), body_range_t(1, 2), time_range_t(3., 12.)));
+	failed += test::compare_records(a, b, fn + " bodies 1..2");
+
+	test::read_records(a, db.scan(sys_range_t(4), ALL)); test::read_records(b, dbref.scan(sys_range_t(4), ALL));
+	failed += test::compare_records(a, b, fn + " scan of system 4");
+
+	swarmdb::count_t c = db.count(ALL, ALL), cref = dbref.count(ALL, ALL);
+	if(c.n != cref.n || c.Tmin != cref.Tmin || c.Tmax != cref.Tmax)
+	{
+		fprintf(stderr, "%s: counted %d records instead of %d\n", fn.c_str(), int(c.n), int(cref.n));
+		failed++;
+	}
+
+	return failed + test::compare_logs(fn, ref);
+}
+
+//! Copy the log ref to the log with output name outname in pieces, querying it after each, and compare the result with ref
+static int check_growing(const std::string &ref, const std::string &outname)
+{
+	std::string out = outname + ".raw";
+	std::ifstream in(ref.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	test::remove_log(outname);
+	// the pieces end in the middle of records
+	const double ends[] = { 0.3, 0.55, 0.8, 1. };
+	size_t at = 0;
+	int failed = 0;
+	for(int k = 0; k < int(sizeof(ends)/sizeof(ends[0])); k++)
+	{
+		size_t end = size_t(ends[k] * data.size()) + (k < 3 ? 7 : 0);
+		std::ofstream o(out.c_str(), std::ios::binary | (k == 0 ? std::ios::trunc : std::ios::app));
+		o.write(&data[at], end - at);
+		o.close();
+		at = end;
+
+		// the queries build or extend the zone map and every index
+		swarmdb db(out);
+		std::vector<std::string> recs;
+		read_body_records(recs, db.query(ALL, body_range_t(0, 1), ALL));
+		test::read_records(recs, db.query_events(evt_range_t(log::EVT_TRANSIT), ALL, ALL));
+		test::read_records(recs, db.query(ALL, ALL));
+		if(recs.empty())
+		{
+			fprintf(stderr, "%s: no records in the first %d bytes\n", out.c_str(), int(end));
+			failed++;
+		}
+	}
+
+	return failed + compare_indexes(out, ref);
+}
+
+/*! Replace the log with output name outname, after querying it, by a copy
+ *  of the larger log ref that starts with different records. The zone map
+ *  and the indexes of the old log must be rebuilt rather than extended.
+ */
+static int check_rewritten(const std::string &ref, const std::string &outname)
+{
+	std::string out = outname + ".raw";
+	{
+		swarmdb db(out);
+		std::vector<std::string> recs;
+		read_body_records(recs, db.query(ALL, body_range_t(0, 1), ALL));
+		test::read_records(recs, db.query(ALL, ALL));
+	}
+
+	std::ifstream in(ref.c_str(), std::ios::binary);
+	std::ofstream o(out.c_str(), std::ios::binary | std::ios::trunc);
+	o << in.rdbuf();
+	o.close();
+
+	return compare_indexes(out, ref);
+}
+
+int main(int argc, char **argv)
+{
+	std::string prefix = argc > 1 ? argv[1] : "index";
+	int failed = 0;
+
+	config plain; plain["log_writer"] = "binary";
+	test::write_log(plain, prefix + ".full");
+	failed += check_growing(prefix + ".full.raw", prefix + ".grown");
+
+	config delta; delta["log_writer"] = "binary"; delta["log_snapshot_encoding"] = "delta";
+	test::write_log(delta, prefix + ".delta-full");
+	failed += check_growing(prefix + ".delta-full.raw", prefix + ".delta-grown");
+
+	// a log written again in place, with more systems and steps
+	test::write_log(plain, prefix + ".rewritten", 200, 12, 3);
+	test::write_log(plain, prefix + ".other", 400, 25, 3);
+	failed += check_rewritten(prefix + ".other.raw", prefix + ".rewritten");
+
+	return failed == 0 ? 0 : 1;
+}
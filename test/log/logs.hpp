@@ -0,0 +1,238 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file logs.hpp
+ *    \brief Writing and reading back the logs of the log test programs.
+ *
+ *
+ */
+
+#pragma once
+#include "swarm/swarm.h"
+#include "swarm/log/io.hpp"
+#include "swarm/log/writer.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace swarm { namespace test {
+
+//! Files of the log with output name out (single file or manifest with segments) and their indexes
+inline void remove_log(const std::string &out)
+{
+	static const char *idx[] = { "", ".time.idx", ".sys.idx", ".evt.idx", ".body.idx", ".zone.idx" };
+	for(int k = 0; k < int(sizeof(idx)/sizeof(idx[0])); k++)
+	{
+		remove((out + ".raw" + idx[k]).c_str());
+		remove((out + ".manifest" + idx[k]).c_str());
+		for(int seg = 0; seg < 1000; seg++)
+		{
+			char segfn[32];
+			sprintf(segfn, ".%04d.raw", seg);
+			remove((out + segfn + idx[k]).c_str());
+		}
+	}
+}
+
+/*! Write nsteps snapshots of nsys systems of nbod bodies, and a few events,
+ *  with the writer configured by cfg to the log with output name out. System 5
+ *  is only logged from step 100 on. The steps are written in the order 0, stride,
+ *  2*stride, ... modulo nsteps (stride and nsteps must not have a common divisor),
+ *  so a stride other than 1 gives a log out of time order. The same arguments
+ *  always give the same records.
+ */
+inline void write_log(config cfg, const std::string &out, int nsteps = 300, int nsys = 20, int nbod = 4, int stride = 1)
+{
+	remove_log(out);
+	cfg["log_output"] = out;
+	log::Pwriter w = log::writer::create(cfg);
+	gpulog::host_log hl(1<<20);
+	for(int k = 0; k < nsteps; k++)
+	{
+		int step = int((long long)k * stride % nsteps);
+		// the records do not set their padding, keep it the same in every log
+		memset(hl.internal_buffer(), 0, hl.capacity());
+		cpu_ensemble ens = cpu_ensemble::create(nbod, nsys);
+		for(int sys = 0; sys < nsys; sys++)
+		{
+			double t = step * 0.05;
+			ens.time(sys) = t;
+			ens[sys].id() = sys;
+			ens.flags(sys) = 0;
+			for(int bod = 0; bod < nbod; bod++)
+			{
+				double r = 1. + bod + 0.1*sys;
+				ens.set_body(sys, bod, bod == 0 ? 1. : 1e-3*bod, r*cos(t/r), r*sin(t/r), 1e-3*bod, -sin(t/r), cos(t/r), 0.);
+			}
+		}
+		// system 5 is only logged from step 100 on
+		for(int sys = 0; sys < nsys; sys++)
+			if(sys != 5 || step >= 100) { log::system(hl, ens, sys); }
+		// a second snapshot of a system at the same time, and events
+		if(step % 7 == 0) { log::system(hl, ens, 3); }
+		if(step % 11 == 0) { log::event(hl, log::EVT_TRANSIT, step * 0.05 + 0.01, step % nsys, 1, 0.3, 0.2); }
+		if(step % 13 == 0) { log::event(hl, log::EVT_RV_OBS, step * 0.05 + 0.02, (step + 5) % nsys, 0, 1.5); }
+		w->process(hl.internal_buffer(), hl.size());
+		hl.clear();
+	}
+}
+
+//! The records of a query result, each as its bytes
+inline void read_records(std::vector<std::string> &recs, query::swarmdb::result r)
+{
+	recs.clear();
+	gpulog::logrecord lr;
+	while(lr = r.next())
+		recs.push_back(std::string(lr.ptr, lr.len()));
+}
+
+//! Compare the records a and b, reporting the first difference as failure what
+inline int compare_records(const std::vector<std::string> &a, const std::vector<std::string> &b, const std::string &what)
+{
+	if(a.size() != b.size())
+	{
+		fprintf(stderr, "%s: %d records instead of %d\n", what.c_str(), int(a.size()), int(b.size()));
+		return 1;
+	}
+	for(int k = 0; k < int(a.size()); k++)
+		if(a[k] != b[k])
+		{
+			fprintf(stderr, "%s: record %d differs\n", what.c_str(), k);
+			return 1;
+		}
+	return 0;
+}
+
+//! Compare the active systems, times and bodies of the ensembles a and b (not the system ids, the snapshots do not set them)
+inline bool same_ensemble(const cpu_ensemble &a, const cpu_ensemble &b)
+{
+	if(a.nsys() != b.nsys() || a.nbod() != b.nbod()) { return false; }
+	for(int sys = 0; sys < a.nsys(); sys++)
+	{
+		if(a[sys].is_active() != b[sys].is_active()) { return false; }
+		if(!a[sys].is_active()) { continue; }
+		if(a.time(sys) != b.time(sys)) { return false; }
+		for(int bod = 0; bod < a.nbod(); bod++)
+			for(int c = 0; c < 3; c++)
+				if(a.p(sys, bod, c) != b.p(sys, bod, c) || a.v(sys, bod, c) != b.v(sys, bod, c)
+					|| a.mass(sys, bod) != b.mass(sys, bod)) { return false; }
+	}
+	return true;
+}
+
+/*! Compare scans of the log db from offsets past its start with the rest of
+ *  the full scan: from a record inside the first zone (of the first block of
+ *  a framed file), from the end of the first zone and from the start of the
+ *  second block. Returns the number of differences.
+ */
+inline int compare_scans_from(const query::swarmdb &db, const std::string &fn)
+{
+	using namespace query;
+	const std::vector<log_block> &blocks = db.get_blocks();
+	const std::vector<log_zone> &zones = db.get_zones();
+
+	// the offsets of the records in log order, as the full scan returns them
+	std::vector<uint64_t> offs;
+	for(int b = 0; b < int(blocks.size()); b++)
+	{
+		swarmdb::Pbuffer hold;
+		const char *begin = db.block_data(blocks[b], hold);
+		gpulog::ilogstream ils(begin, blocks[b].len);
+		gpulog::logrecord lr;
+		while(lr = ils.next())
+			offs.push_back(blocks[b].offs + (lr.ptr - begin));
+	}
+
+	std::vector<std::string> all, a;
+	read_records(all, db.scan(ALL, ALL));
+	if(all.size() != offs.size() || zones.size() < 2)
+	{
+		fprintf(stderr, "%s: %d records scanned, %d stored in %d zones\n", fn.c_str(), int(all.size()), int(offs.size()), int(zones.size()));
+		return 1;
+	}
+
+	std::vector<uint64_t> from;
+	from.push_back(offs[zones[0].nrecords / 2]);
+	from.push_back(blocks[zones[0].block].offs + zones[0].end);
+	if(blocks.size() > 1) { from.push_back(blocks[1].offs); }
+
+	int failed = 0;
+	for(int k = 0; k < int(from.size()); k++)
+	{
+		int first = std::lower_bound(offs.begin(), offs.end(), from[k]) - offs.begin();
+		std::vector<std::string> b(all.begin() + first, all.end());
+		read_records(a, db.scan(ALL, ALL, from[k]));
+		char what[64];
+		sprintf(what, " scan from offset %d", int(from[k]));
+		failed += compare_records(a, b, fn + what);
+	}
+	return failed;
+}
+
+/*! Compare the log fn with the reference log ref: all the records, a system
+ *  and time range (from the indexes and in log order), an event range and the
+ *  snapshots of a time range. Scans of both logs from offsets past the start
+ *  are checked too. Returns the number of differences.
+ */
+inline int compare_logs(const std::string &fn, const std::string &ref)
+{
+	using namespace query;
+	swarmdb db(fn), dbref(ref);
+	std::vector<std::string> a, b;
+	int failed = 0;
+
+	read_records(a, db.query(ALL, ALL)); read_records(b, dbref.query(ALL, ALL));
+	failed += compare_records(a, b, fn + " all");
+	int nrecords = b.size();
+
+	read_records(a, db.query(sys_range_t(3, 5), time_range_t(2., 7.))); read_records(b, dbref.query(sys_range_t(3, 5), time_range_t(2., 7.)));
+	failed += compare_records(a, b, fn + " systems 3..5 at 2..7");
+
+	read_records(a, db.scan(ALL, ALL)); read_records(b, dbref.scan(ALL, ALL));
+	failed += compare_records(a, b, fn + " scan");
+
+	read_records(a, db.scan(sys_range_t(3, 5), time_range_t(2., 7.))); read_records(b, dbref.scan(sys_range_t(3, 5), time_range_t(2., 7.)));
+	failed += compare_records(a, b, fn + " scan of systems 3..5 at 2..7");
+
+	read_records(a, db.query_events(evt_range_t(log::EVT_RV_OBS, log::EVT_TRANSIT), ALL, ALL));
+	read_records(b, dbref.query_events(evt_range_t(log::EVT_RV_OBS, log::EVT_TRANSIT), ALL, ALL));
+	failed += compare_records(a, b, fn + " events");
+
+	swarmdb::snapshots s = db.get_snapshots(time_range_t(5., 6.)), sref = dbref.get_snapshots(time_range_t(5., 6.));
+	cpu_ensemble ens, ensref;
+	int n = 0;
+	bool more = true;
+	while(more)
+	{
+		more = s.next(ens);
+		if(more != sref.next(ensref) || (more && !same_ensemble(ens, ensref)))
+		{
+			fprintf(stderr, "%s: snapshot %d differs\n", fn.c_str(), n);
+			failed++;
+			break;
+		}
+		n++;
+	}
+
+	failed += compare_scans_from(db, fn) + compare_scans_from(dbref, ref);
+
+	printf("%s: %d records, %d blocks, %d differences\n", fn.c_str(), nrecords, int(db.get_blocks().size()), failed);
+	return failed;
+}
+
+} }
@@ -0,0 +1,679 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file queries.cpp
+ *    \brief Tests the swarmdb queries answered from the indexes against a full scan of the log.
+ *
+ *  The csv, binary, columnar and text output of the whole log must hold the
+ *  same rows, and the aggregates must match reductions of those rows.
+ *
+ *  Usage: queries <prefix>, the logs are written to <prefix>.<name>.
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "logs.hpp"
+#include "swarm/query.hpp"
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+using namespace swarm;
+using namespace swarm::query;
+
+//! A record of the full scan
+struct scanned_record
+{
+	double T;
+	int sys, evt;
+	std::string data;
+
+	static bool time_less(const scanned_record *a, const scanned_record *b) { return a->T < b->T; }
+};
+
+//! All the records of the log, in log order
+static void full_scan(std::vector<scanned_record> &recs, const swarmdb &db)
+{
+	recs.clear();
+	swarmdb::result r = db.scan(ALL, ALL);
+	gpulog::logrecord lr;
+	while(lr = r.next())
+	{
+		scanned_record s;
+		s.data.assign(lr.ptr, lr.len());
+		s.evt = lr.msgid();
+		lr >> s.T >> s.sys;
+		recs.push_back(s);
+	}
+}
+
+//! Compare snapshot_at(T) with the last snapshot of each system at or before T
+static int check_snapshot_at(const swarmdb &db, const std::vector<scanned_record> &recs, double T)
+{
+	std::vector<const scanned_record *> last;
+	for(int k = 0; k < int(recs.size()); k++)
+	{
+		const scanned_record &s = recs[k];
+		if(s.evt != log::EVT_SNAPSHOT || s.T > T) { continue; }
+		if(s.sys >= int(last.size())) { last.resize(s.sys + 1, NULL); }
+		if(last[s.sys] == NULL || last[s.sys]->T <= s.T) { last[s.sys] = &s; }
+	}
+
+	cpu_ensemble ens;
+	bool found = db.snapshot_at(ens, T);
+	if(found != !last.empty())
+	{
+		fprintf(stderr, "snapshot_at(%g): %s a snapshot\n", T, found ? "found" : "did not find");
+		return 1;
+	}
+	if(!found) { return 0; }
+
+	if(ens.nsys() != int(last.size()))
+	{
+		fprintf(stderr, "snapshot_at(%g): %d systems instead of %d\n", T, ens.nsys(), int(last.size()));
+		return 1;
+	}
+	for(int sys = 0; sys < ens.nsys(); sys++)
+	{
+		if(last[sys] == NULL)
+		{
+			if(ens[sys].is_active()) { fprintf(stderr, "snapshot_at(%g): system %d is active\n", T, sys); return 1; }
+			continue;
+		}
+
+		gpulog::logrecord lr(last[sys]->data.data());
+		double Ts; int s, flags, nbod; const log::body *bodies;
+		lr >> Ts >> s >> flags >> nbod >> bodies;
+		bool same = ens[sys].is_active() && ens.time(sys) == Ts && ens.nbod() == nbod;
+		for(int bod = 0; same && bod < nbod; bod++)
+		{
+			const log::body &b = bodies[bod];
+			same = ens.mass(sys, bod) == b.mass && ens.x(sys, bod) == b.x && ens.y(sys, bod) == b.y && ens.z(sys, bod) == b.z
+				&& ens.vx(sys, bod) == b.vx && ens.vy(sys, bod) == b.vy && ens.vz(sys, bod) == b.vz;
+		}
+		if(!same)
+		{
+			fprintf(stderr, "snapshot_at(%g): system %d differs from its snapshot at %g\n", T, sys, Ts);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//! Compare system_ranges(sys, T) with the records of each system in the scan, in time order
+static int check_system_ranges(const swarmdb &db, const std::vector<scanned_record> &recs, sys_range_t sys, time_range_t T)
+{
+	std::map<int, std::vector<const scanned_record *> > expected;
+	for(int k = 0; k < int(recs.size()); k++)
+		if(sys.in(recs[k].sys) && T.in(recs[k].T)) { expected[recs[k].sys].push_back(&recs[k]); }
+
+	std::vector<swarmdb::result::index_range> ranges;
+	db.system_ranges(ranges, sys, T);
+	if(ranges.size() != expected.size())
+	{
+		fprintf(stderr, "system_ranges(%d..%d, %g..%g): %d ranges instead of %d\n", sys.first, sys.last, T.first, T.last, int(ranges.size()), int(expected.size()));
+		return 1;
+	}
+
+	std::map<int, std::vector<const scanned_record *> >::iterator e = expected.begin();
+	for(int k = 0; k < int(ranges.size()); k++, e++)
+	{
+		std::vector<const scanned_record *> &sr = e->second;
+		std::stable_sort(sr.begin(), sr.end(), scanned_record::time_less);
+		bool same = ranges[k].second - ranges[k].first == int(sr.size());
+		for(int i = 0; same && i < int(sr.size()); i++)
+		{
+			const swarmdb::index_entry &ie = ranges[k].first[i];
+			swarmdb::Pbuffer hold;
+			gpulog::logrecord lr(db.get_record(ie, hold));
+			same = ie.sys == e->first && std::string(lr.ptr, lr.len()) == sr[i]->data;
+		}
+		if(!same)
+		{
+			fprintf(stderr, "system_ranges(%d..%d, %g..%g): the range of system %d differs\n", sys.first, sys.last, T.first, T.last, e->first);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//! Whether the counts a and b are the same (their times are NaN if there are no records)
+static bool same_count(const swarmdb::count_t &a, const swarmdb::count_t &b)
+{
+	if(a.sys != b.sys || a.n != b.n) { return false; }
+	if(a.n == 0) { return a.Tmin != a.Tmin && a.Tmax != a.Tmax; }
+	return a.Tmin == b.Tmin && a.Tmax == b.Tmax;
+}
+
+//! Add the record s to the count c
+static void add_record(swarmdb::count_t &c, const scanned_record &s)
+{
+	c.Tmin = c.n == 0 ? s.T : std::min(c.Tmin, s.T);
+	c.Tmax = c.n == 0 ? s.T : std::max(c.Tmax, s.T);
+	c.n++;
+}
+
+//! Compare count and count_systems with the records in the scan
+static int check_count(const swarmdb &db, const std::vector<scanned_record> &recs, sys_range_t sys, time_range_t T, evt_range_t evt)
+{
+	swarmdb::count_t expected = { -1, 0, 0., 0. };
+	std::map<int, swarmdb::count_t> per_system;
+	for(int k = 0; k < int(recs.size()); k++)
+	{
+		const scanned_record &s = recs[k];
+		if(s.sys < 0 || !sys.in(s.sys) || !T.in(s.T) || !evt.in(s.evt)) { continue; }
+		add_record(expected, s);
+		if(!per_system.count(s.sys))
+		{
+			swarmdb::count_t c = { s.sys, 0, 0., 0. };
+			per_system[s.sys] = c;
+		}
+		add_record(per_system[s.sys], s);
+	}
+
+	swarmdb::count_t c = db.count(sys, T, evt);
+	std::vector<swarmdb::count_t> counts;
+	db.count_systems(counts, sys, T, evt);
+
+	bool same = same_count(c, expected) && counts.size() == per_system.size();
+	std::map<int, swarmdb::count_t>::const_iterator e = per_system.begin();
+	for(int k = 0; same && k < int(counts.size()); k++, e++)
+		same = same_count(counts[k], e->second);
+
+	if(!same)
+	{
+		fprintf(stderr, "count(%d..%d, %g..%g, %d..%d): %d records in %g..%g instead of %d in %g..%g, or the counts of the systems differ\n",
+			sys.first, sys.last, T.first, T.last, evt.first, evt.last, int(c.n), c.Tmin, c.Tmax, int(expected.n), expected.Tmin, expected.Tmax);
+		return 1;
+	}
+	return 0;
+}
+
+//! Output of execute on the whole log fn in the output format f
+static std::string query_output(const std::string &fn, output_format_t f)
+{
+	std::ostringstream out;
+	std::streambuf *old = std::cout.rdbuf(out.rdbuf());
+	set_output_format(f);
+	try
+	{
+		execute(fn, ALL, ALL);
+	}
+	catch(...)
+	{
+		std::cout.rdbuf(old);
+		throw;
+	}
+	std::cout.rdbuf(old);
+	return out.str();
+}
+
+//! Whether the rows a and b hold the same values (NaN equals NaN)
+static bool same_row(const swarm_export_row &a, const swarm_export_row &b)
+{
+	if(a.evt != b.evt || a.sys != b.sys || a.body != b.body || a.flags != b.flags) { return false; }
+	const double *va = &a.mass, *vb = &b.mass;
+	for(int k = 0; k < 7; k++)
+		if(va[k] != vb[k] && (va[k] == va[k] || vb[k] == vb[k])) { return false; }
+	return a.time == b.time;
+}
+
+//! Whether the text t is the value v printed with prec significant digits
+static bool same_printed(const std::string &t, double v, int prec)
+{
+	double x = strtod(t.c_str(), NULL);
+	if(x != x || v != v) { return x != x && v != v; }
+	return fabs(x - v) <= 0.6 * pow(10., 1 - prec) * fabs(v);
+}
+
+//! The columns of the binary and columnar output: name, numpy type, size and offset in a row
+struct export_column
+{
+	const char *name, *type;
+	uint32_t size;
+	size_t offs;
+};
+
+static std::vector<export_column> expected_columns(bool keplerian)
+{
+	static const char *cartesian[6] = { "x", "y", "z", "vx", "vy", "vz" };
+	static const char *elements[6] = { "a", "e", "i", "O", "w", "M" };
+	export_column cols[6] = {
+		{ "time", "<f8", 8, offsetof(swarm_export_row, time) },
+		{ "evt", "<i4", 4, offsetof(swarm_export_row, evt) },
+		{ "sys", "<i4", 4, offsetof(swarm_export_row, sys) },
+		{ "body", "<i4", 4, offsetof(swarm_export_row, body) },
+		{ "flags", "<i4", 4, offsetof(swarm_export_row, flags) },
+		{ "mass", "<f8", 8, offsetof(swarm_export_row, mass) } };
+	std::vector<export_column> c(cols, cols + 6);
+	for(int k = 0; k != 6; k++)
+	{
+		export_column e = { keplerian ? elements[k] : cartesian[k], "<f8", 8, offsetof(swarm_export_row, c) + 8*k };
+		c.push_back(e);
+	}
+	return c;
+}
+
+//! Parse the rows of the csv output, returns the number of errors
+static int parse_csv(std::vector<swarm_export_row> &rows, const std::string &csv, bool keplerian, const std::string &what)
+{
+	std::vector<export_column> cols = expected_columns(keplerian);
+	std::string header = "evt,time,sys,body,mass";
+	for(int k = 6; k != 12; k++) { header = header + "," + cols[k].name; }
+	header += ",flags";
+
+	std::istringstream in(csv);
+	std::string line;
+	if(!std::getline(in, line) || line != header)
+	{
+		fprintf(stderr, "%s: csv header '%s' instead of '%s'\n", what.c_str(), line.c_str(), header.c_str());
+		return 1;
+	}
+	while(std::getline(in, line))
+	{
+		swarm_export_row r;
+		double *c = r.c;
+		if(sscanf(line.c_str(), "%d,%lf,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%d", &r.evt, &r.time, &r.sys, &r.body, &r.mass,
+			&c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &r.flags) != 12)
+		{
+			fprintf(stderr, "%s: cannot parse csv row '%s'\n", what.c_str(), line.c_str());
+			return 1;
+		}
+		rows.push_back(r);
+	}
+	return 0;
+}
+
+/*! Parse the rows of the binary or of the columnar output, checking the
+ *  header, the column entries, the offsets of the columns and their zero
+ *  padding. Returns the number of errors.
+ */
+static int parse_export(std::vector<swarm_export_row> &rows, const std::string &data, bool columnar, bool keplerian, const std::string &what)
+{
+	std::vector<export_column> expected = expected_columns(keplerian);
+	swarm_export_header hdr("");
+	size_t at = sizeof(hdr) + expected.size() * sizeof(swarm_export_column);
+	if(data.size() < at)
+	{
+		fprintf(stderr, "%s: %d bytes are too short for the header\n", what.c_str(), int(data.size()));
+		return 1;
+	}
+	memcpy(&hdr, &data[0], sizeof(hdr));
+	if(hdr.type() != (columnar ? "query_columns" : "query_rows") || hdr.ncolumns != expected.size() || hdr.rowsize != sizeof(swarm_export_row)
+		|| (!columnar && hdr.nrows != swarm_header::npos))
+	{
+		fprintf(stderr, "%s: unexpected header (type '%s', %d columns, rows of %d bytes)\n", what.c_str(), hdr.type().c_str(), int(hdr.ncolumns), int(hdr.rowsize));
+		return 1;
+	}
+
+	std::vector<swarm_export_column> cols(expected.size());
+	memcpy(&cols[0], &data[sizeof(hdr)], cols.size() * sizeof(cols[0]));
+	uint64_t nrows = columnar ? hdr.nrows : (data.size() - at) / sizeof(swarm_export_row);
+	for(int k = 0; k < int(cols.size()); k++)
+	{
+		const export_column &e = expected[k];
+		uint64_t offs = columnar ? at : e.offs;
+		if(std::string(cols[k].name) != e.name || std::string(cols[k].type) != e.type || cols[k].size != e.size || cols[k].offset != offs)
+		{
+			fprintf(stderr, "%s: column %d is %s %s of %d bytes at %d instead of %s %s at %d\n", what.c_str(), k,
+				cols[k].name, cols[k].type, int(cols[k].size), int(cols[k].offset), e.name, e.type, int(offs));
+			return 1;
+		}
+		if(!columnar) { continue; }
+
+		// each column is padded with zeros to 16 bytes
+		uint64_t end = at + (nrows * e.size + 15) / 16 * 16;
+		if(end > data.size() || data.find_first_not_of('\0', at + nrows * e.size) < end)
+		{
+			fprintf(stderr, "%s: column %s is truncated or not padded with zeros\n", what.c_str(), e.name);
+			return 1;
+		}
+		at = end;
+	}
+	if(columnar ? data.size() != at : (data.size() - at) % sizeof(swarm_export_row) != 0)
+	{
+		fprintf(stderr, "%s: %d bytes after the rows\n", what.c_str(), int(data.size() - at));
+		return 1;
+	}
+
+	rows.resize(nrows);
+	for(uint64_t i = 0; i < nrows; i++)
+	{
+		if(!columnar)
+		{
+			memcpy(&rows[i], &data[sizeof(hdr) + cols.size() * sizeof(cols[0]) + i * sizeof(swarm_export_row)], sizeof(swarm_export_row));
+			continue;
+		}
+		for(int k = 0; k < int(cols.size()); k++)
+			memcpy((char *)&rows[i] + expected[k].offs, &data[cols[k].offset + i * cols[k].size], cols[k].size);
+	}
+	return 0;
+}
+
+/*! Compare the lines of the text output with the csv rows: the same events,
+ *  systems and bodies, and the values as far as the text prints them
+ */
+static int compare_text(const std::string &text, const std::vector<swarm_export_row> &rows, const std::string &what)
+{
+	std::istringstream in(text);
+	std::string line;
+	int n = 0;
+	for(; std::getline(in, line); n++)
+	{
+		if(n >= int(rows.size())) { continue; }
+		const swarm_export_row &r = rows[n];
+		// evt T sys body, and mass c[0] ... c[5] flags for snapshots
+		std::istringstream l(line);
+		std::vector<std::string> t;
+		std::string token;
+		while(l >> token) { t.push_back(token); }
+		bool same = t.size() >= 4 && atoi(t[0].c_str()) == r.evt && same_printed(t[1], r.time, 6)
+			&& atoi(t[2].c_str()) == r.sys && atoi(t[3].c_str()) == r.body;
+		if(same && r.evt == log::EVT_SNAPSHOT)
+		{
+			same = t.size() == 12 && same_printed(t[4], r.mass, 6) && atoi(t[11].c_str()) == r.flags;
+			for(int k = 0; same && k < 6; k++)
+				same = same_printed(t[5 + k], r.c[k], 5);
+		}
+		if(!same)
+		{
+			fprintf(stderr, "%s: text line %d '%s' differs from the csv row\n", what.c_str(), n, line.c_str());
+			return 1;
+		}
+	}
+	if(n != int(rows.size()))
+	{
+		fprintf(stderr, "%s: %d text lines instead of %d csv rows\n", what.c_str(), n, int(rows.size()));
+		return 1;
+	}
+	return 0;
+}
+
+/*! Compare the csv, binary, columnar and text output of the whole log fn
+ *  with each other, the csv rows are returned in rows
+ */
+static int check_outputs(std::vector<swarm_export_row> &rows, const std::string &fn, bool keplerian)
+{
+	std::string what = fn + (keplerian ? " Keplerian" : " Cartesian");
+	rows.clear();
+	if(parse_csv(rows, query_output(fn, csv_format), keplerian, what + " csv")) { return 1; }
+	if(rows.empty())
+	{
+		fprintf(stderr, "%s: no csv rows\n", what.c_str());
+		return 1;
+	}
+
+	int failed = 0;
+	const output_format_t formats[] = { binary_format, columnar_format };
+	for(int f = 0; f < 2; f++)
+	{
+		bool columnar = formats[f] == columnar_format;
+		std::string fwhat = what + (columnar ? " columnar" : " binary");
+		std::vector<swarm_export_row> r;
+		if(parse_export(r, query_output(fn, formats[f]), columnar, keplerian, fwhat)) { failed++; continue; }
+
+		bool same = r.size() == rows.size();
+		int k = 0;
+		while(same && k < int(r.size()) && same_row(r[k], rows[k])) { k++; }
+		if(!same || k != int(r.size()))
+		{
+			fprintf(stderr, "%s: %d rows, row %d differs from the csv row\n", fwhat.c_str(), int(r.size()), k);
+			failed++;
+		}
+	}
+
+	failed += compare_text(query_output(fn, text_format), rows, what + " text");
+	return failed;
+}
+
+//! Check parse_aggregates on a list of reductions and on malformed ones
+static int check_parse_aggregates()
+{
+	int failed = 0;
+	std::vector<aggregate_t> a = parse_aggregates("max(e), min( q ),mean(x),first(time) ,last(mass)");
+	const aggregate_op_t ops[] = { aggregate_max, aggregate_min, aggregate_mean, aggregate_first, aggregate_last };
+	const char *fields[] = { "e", "q", "x", "time", "mass" };
+	bool same = a.size() == 5;
+	for(int k = 0; same && k < 5; k++)
+		same = a[k].op == ops[k] && a[k].field == fields[k];
+	if(!same)
+	{
+		fprintf(stderr, "parse_aggregates: the reductions differ\n");
+		failed++;
+	}
+
+	const char *bad[] = { "", "max(e", "max e", "median(x)", "max(e),", "(e)" };
+	for(int k = 0; k < int(sizeof(bad)/sizeof(bad[0])); k++)
+	{
+		try
+		{
+			parse_aggregates(bad[k]);
+			fprintf(stderr, "parse_aggregates: '%s' is accepted\n", bad[k]);
+			failed++;
+		}
+		catch(const std::exception &) {}
+	}
+	return failed;
+}
+
+//! Reductions of one field of the rows of a group, leaving NaN out
+struct reduction
+{
+	long n;
+	double sum, min, max, first, last;
+
+	reduction() : n(0), sum(0.), min(0.), max(0.), first(0.), last(0.) {}
+
+	void add(double v)
+	{
+		if(v != v) { return; }
+		if(n == 0) { first = min = max = v; }
+		min = std::min(min, v); max = std::max(max, v);
+		last = v; sum += v; n++;
+	}
+};
+
+//! The value of field name of the row, with the pericentre and apocentre of the Keplerian rows
+static double row_field(const swarm_export_row &r, const std::string &name)
+{
+	if(name == "time") { return r.time; }
+	if(name == "mass") { return r.mass; }
+	if(name == "q") { return r.c[0] * (1 - r.c[1]); }
+	if(name == "Q") { return r.c[0] * (1 + r.c[1]); }
+	const char *names[] = { "x", "y", "z", "vx", "vy", "vz", "a", "e", "i", "O", "w", "M" };
+	for(int k = 0; k < 12; k++)
+		if(name == names[k]) { return r.c[k % 6]; }
+	return std::numeric_limits<double>::quiet_NaN();
+}
+
+/*! Compare the csv output of aggregate on the log fn with the reductions
+ *  of the csv rows of the whole log per system or per body
+ */
+static int check_aggregate(const std::string &fn, const std::vector<swarm_export_row> &rows, const std::string &spec,
+	group_by_t group_by, sys_range_t sys, time_range_t T)
+{
+	std::vector<aggregate_t> aggs = parse_aggregates(spec);
+
+	// groups by system and body (-1 by system), in output order
+	typedef std::map<std::pair<int, int>, std::pair<long, std::vector<reduction> > > groups_t;
+	groups_t expected;
+	for(int i = 0; i < int(rows.size()); i++)
+	{
+		const swarm_export_row &r = rows[i];
+		if(!sys.in(r.sys) || !T.in(r.time) || (group_by == group_by_body && r.body < 0)) { continue; }
+		std::pair<long, std::vector<reduction> > &g = expected[std::make_pair(r.sys, group_by == group_by_body ? r.body : -1)];
+		g.first++;
+		g.second.resize(aggs.size());
+		for(int k = 0; k < int(aggs.size()); k++)
+			g.second[k].add(row_field(r, aggs[k].field));
+	}
+
+	std::ostringstream out;
+	std::streambuf *old = std::cout.rdbuf(out.rdbuf());
+	set_output_format(csv_format);
+	try
+	{
+		aggregate(fn, aggs, group_by, T, sys);
+	}
+	catch(...)
+	{
+		std::cout.rdbuf(old);
+		throw;
+	}
+	std::cout.rdbuf(old);
+
+	char what[256];
+	snprintf(what, sizeof(what), "%s aggregate %s by %s of systems %d..%d at %g..%g", fn.c_str(), spec.c_str(),
+		group_by == group_by_body ? "body" : "system", sys.first, sys.last, T.first, T.last);
+
+	std::istringstream in(out.str());
+	std::string line;
+	std::getline(in, line);
+	groups_t::const_iterator e = expected.begin();
+	for(int n = 0; std::getline(in, line); n++, e++)
+	{
+		// sys[,body],rows,values
+		std::vector<double> v;
+		std::istringstream l(line);
+		std::string field;
+		while(std::getline(l, field, ','))
+			v.push_back(strtod(field.c_str(), NULL));
+
+		int nkeys = group_by == group_by_body ? 2 : 1;
+		bool same = e != expected.end() && int(v.size()) == nkeys + 1 + int(aggs.size())
+			&& v[0] == e->first.first && (nkeys == 1 || v[1] == e->first.second) && v[nkeys] == e->second.first;
+		for(int k = 0; same && k < int(aggs.size()); k++)
+		{
+			const reduction &r = e->second.second[k];
+			double x = v[nkeys + 1 + k], ref = std::numeric_limits<double>::quiet_NaN();
+			if(r.n != 0)
+			{
+				switch(aggs[k].op)
+				{
+				case aggregate_min:   ref = r.min; break;
+				case aggregate_max:   ref = r.max; break;
+				case aggregate_mean:  ref = r.sum / r.n; break;
+				case aggregate_first: ref = r.first; break;
+				case aggregate_last:  ref = r.last; break;
+				}
+			}
+			// the means may add the values up in another order
+			if(aggs[k].op == aggregate_mean)
+				same = (x != x && ref != ref) || fabs(x - ref) <= 1e-12 * fabs(ref);
+			else
+				same = x == ref || (x != x && ref != ref);
+		}
+		if(!same)
+		{
+			fprintf(stderr, "%s: group %d '%s' differs\n", what, n, line.c_str());
+			return 1;
+		}
+	}
+	if(e != expected.end())
+	{
+		fprintf(stderr, "%s: %d groups are missing\n", what, int(std::distance(e, groups_t::const_iterator(expected.end()))));
+		return 1;
+	}
+	return 0;
+}
+
+//! Check the outputs of execute and the aggregates on the log fn, in Cartesian and in Keplerian coordinates
+static int check_output(const std::string &fn)
+{
+	int failed = 0;
+	std::vector<swarm_export_row> rows;
+
+	set_cartesian_output(jacobi);
+	failed += check_outputs(rows, fn, false);
+	const char *spec = "min(x),max(vz),mean(y),first(time),last(mass),mean(mass)";
+	failed += check_aggregate(fn, rows, spec, group_by_system, ALL, ALL);
+	failed += check_aggregate(fn, rows, spec, group_by_body, ALL, ALL);
+	failed += check_aggregate(fn, rows, spec, group_by_system, sys_range_t(3, 6), time_range_t(2., 7.));
+
+	set_keplerian_output(jacobi);
+	failed += check_outputs(rows, fn, true);
+	spec = "max(e),min(q),max(Q),mean(a),first(i),last(M)";
+	failed += check_aggregate(fn, rows, spec, group_by_body, ALL, ALL);
+	failed += check_aggregate(fn, rows, spec, group_by_body, sys_range_t(4, 5), time_range_t(1., 9.));
+
+	// the defaults of the query output
+	set_cartesian_output(jacobi);
+	set_output_format(text_format);
+	return failed;
+}
+
+//! Check the queries on the log fn
+static int check_log(const std::string &fn)
+{
+	swarmdb db(fn);
+	std::vector<scanned_record> recs;
+	full_scan(recs, db);
+
+	int failed = 0;
+
+	// before the first snapshot, at snapshot times, between them and after the last
+	const double times[] = { -1., 0., 0.025, 2., 5.01, 7.3, 14.95, 100. };
+	for(int k = 0; k < int(sizeof(times)/sizeof(times[0])); k++)
+		failed += check_snapshot_at(db, recs, times[k]);
+
+	failed += check_system_ranges(db, recs, ALL, ALL);
+	failed += check_system_ranges(db, recs, sys_range_t(4, 7), time_range_t(1.02, 6.));
+	failed += check_system_ranges(db, recs, sys_range_t(5), time_range_t(0., 4.));
+	failed += check_system_ranges(db, recs, sys_range_t(30, 40), ALL);
+	failed += check_system_ranges(db, recs, ALL, time_range_t(100., 200.));
+
+	// whole zones, parts of zones, single events and ranges without records
+	failed += check_count(db, recs, ALL, ALL, ALL);
+	failed += check_count(db, recs, sys_range_t(2, 9), time_range_t(1.01, 9.5), ALL);
+	failed += check_count(db, recs, sys_range_t(5), ALL, ALL);
+	failed += check_count(db, recs, ALL, time_range_t(3., 3.), ALL);
+	failed += check_count(db, recs, ALL, ALL, evt_range_t(log::EVT_TRANSIT));
+	failed += check_count(db, recs, sys_range_t(0, 9), time_range_t(2., 12.), evt_range_t(log::EVT_RV_OBS, log::EVT_TRANSIT));
+	failed += check_count(db, recs, ALL, ALL, evt_range_t(log::EVT_SNAPSHOT));
+	failed += check_count(db, recs, sys_range_t(30, 40), ALL, ALL);
+	failed += check_count(db, recs, ALL, time_range_t(100., 200.), ALL);
+
+	failed += check_output(fn);
+
+	printf("%s: %d records, %d failures\n", fn.c_str(), int(recs.size()), failed);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	std::string prefix = argc > 1 ? argv[1] : "queries";
+	int failed = 0;
+
+	failed += check_parse_aggregates();
+
+	config plain; plain["log_writer"] = "binary";
+	test::write_log(plain, prefix + ".plain");
+	failed += check_log(prefix + ".plain.raw");
+
+	config delta; delta["log_writer"] = "binary"; delta["log_snapshot_encoding"] = "delta";
+	delta["log_block_size"] = "16384";
+	test::write_log(delta, prefix + ".delta");
+	failed += check_log(prefix + ".delta.raw");
+
+	config segmented; segmented["log_writer"] = "binary"; segmented["log_segment_size"] = "200000";
+	test::write_log(segmented, prefix + ".segmented");
+	failed += check_log(prefix + ".segmented.manifest");
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file roundtrip.cpp
+ *    \brief Tests that logs in the other formats read back the same as a plain binary log.
+ *
+ *  Usage: roundtrip <prefix>, the logs are written to <prefix>.<name>.raw.
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "logs.hpp"
+
+using namespace swarm;
+
+int main(int argc, char **argv)
+{
+	std::string prefix = argc > 1 ? argv[1] : "roundtrip";
+
+	config plain; plain["log_writer"] = "binary";
+	test::write_log(plain, prefix + ".plain");
+	std::string ref = prefix + ".plain.raw";
+
+	int failed = 0;
+
+	// block-framed logs, with small blocks so that the queries span many
+	config framed; framed["log_writer"] = "binary"; framed["log_block_size"] = "16384";
+	test::write_log(framed, prefix + ".framed");
+	failed += test::compare_logs(prefix + ".framed.raw", ref);
+
+	// block-compressed logs, with each codec that is compiled in
+	std::vector<std::string> codecs;
+#ifdef SWARM_HAVE_LZ4
+	codecs.push_back("lz4");
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	codecs.push_back("zstd");
+#endif
+	for(int k = 0; k < int(codecs.size()); k++)
+	{
+		config compressed; compressed["log_writer"] = "compressed"; compressed["log_compression"] = codecs[k];
+		compressed["log_block_size"] = "16384";
+		test::write_log(compressed, prefix + "." + codecs[k]);
+		failed += test::compare_logs(prefix + "." + codecs[k] + ".raw", ref);
+	}
+
+	// delta-encoded snapshots, in a plain, a framed and a compressed log
+	config delta; delta["log_writer"] = "binary"; delta["log_snapshot_encoding"] = "delta"; delta["log_keyframe_interval"] = "16";
+	test::write_log(delta, prefix + ".delta");
+	failed += test::compare_logs(prefix + ".delta.raw", ref);
+
+	delta["log_block_size"] = "16384";
+	test::write_log(delta, prefix + ".delta-framed");
+	failed += test::compare_logs(prefix + ".delta-framed.raw", ref);
+
+	if(!codecs.empty())
+	{
+		delta["log_writer"] = "compressed"; delta["log_compression"] = codecs[0];
+		test::write_log(delta, prefix + ".delta-" + codecs[0]);
+		failed += test::compare_logs(prefix + ".delta-" + codecs[0] + ".raw", ref);
+	}
+
+	return failed == 0 ? 0 : 1;
+}
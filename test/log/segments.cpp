@@ -0,0 +1,86 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file segments.cpp
+ *    \brief Tests that a log split into segments reads back like one log file.
+ *
+ *  Usage: segments <prefix>, the logs are written to <prefix>.<name>.
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "logs.hpp"
+
+using namespace swarm;
+
+//! Number of segment files of the segmented log with output name out
+static int count_segments(const std::string &out)
+{
+	int n = 0;
+	while(true)
+	{
+		char segfn[32];
+		sprintf(segfn, ".%04d.raw", n);
+		FILE *f = fopen((out + segfn).c_str(), "rb");
+		if(f == NULL) { return n; }
+		fclose(f);
+		n++;
+	}
+}
+
+//! Write a segmented log with cfg and compare it with the log file ref
+static int check_segmented(config cfg, const std::string &out, const std::string &ref)
+{
+	test::write_log(cfg, out);
+	int nseg = count_segments(out);
+	printf("%s: %d segments\n", out.c_str(), nseg);
+	if(nseg < 2)
+	{
+		fprintf(stderr, "%s: the log was not split into segments\n", out.c_str());
+		return 1;
+	}
+	return test::compare_logs(out + ".manifest", ref);
+}
+
+int main(int argc, char **argv)
+{
+	std::string prefix = argc > 1 ? argv[1] : "segments";
+
+	config plain; plain["log_writer"] = "binary";
+	test::write_log(plain, prefix + ".single");
+	std::string ref = prefix + ".single.raw";
+
+	int failed = 0;
+
+	// segments of a given size
+	config bysize; bysize["log_writer"] = "binary"; bysize["log_segment_size"] = "200000";
+	failed += check_segmented(bysize, prefix + ".size", ref);
+
+	// segments of a given time span, with framed blocks and delta-encoded snapshots
+	config bytime; bytime["log_writer"] = "binary"; bytime["log_segment_time"] = "4";
+	bytime["log_block_size"] = "16384"; bytime["log_snapshot_encoding"] = "delta";
+	failed += check_segmented(bytime, prefix + ".time", ref);
+
+#if defined(SWARM_HAVE_LZ4) || defined(SWARM_HAVE_ZSTD)
+	// compressed segments
+	config compressed; compressed["log_writer"] = "compressed"; compressed["log_segment_size"] = "100000";
+	compressed["log_block_size"] = "16384";
+	failed += check_segmented(compressed, prefix + ".compressed", ref);
+#endif
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file sort.cpp
+ *    \brief Tests the external sort of a log against a sort in memory.
+ *
+ *  Logs written out of time order are sorted by sort_binary_log_file with
+ *  little memory, so the file is split into many runs and the runs are read
+ *  back in chunks that end in the middle of records. The records of the
+ *  sorted file must be those of the log stably sorted by time and system.
+ *
+ *  Usage: sort <prefix>, the logs are written to <prefix>.<name>.raw.
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "logs.hpp"
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+using namespace swarm;
+using namespace swarm::query;
+
+//! A record of a log and its sort key
+struct keyed_record
+{
+	double T;
+	int sys;
+	std::string data;
+
+	bool operator< (const keyed_record &a) const
+	{
+		return T < a.T || (T == a.T && sys < a.sys);
+	}
+};
+
+//! Append the records of the memory range [begin, begin + len) to recs
+static void add_records(std::vector<keyed_record> &recs, const char *begin, size_t len)
+{
+	gpulog::ilogstream ils(begin, len);
+	gpulog::logrecord lr;
+	while(lr = ils.next())
+	{
+		keyed_record r;
+		gpulog::logrecord l = lr;
+		get_Tsys(l, r.T, r.sys);
+		r.data.assign(lr.ptr, lr.len());
+		recs.push_back(r);
+	}
+}
+
+//! Sort the log fn with max_memory bytes and compare the result with a stable sort of its records
+static int check_sort(const std::string &fn, size_t max_memory)
+{
+	// the records as they are stored, compact snapshots are not expanded
+	std::vector<keyed_record> expected;
+	{
+		swarmdb db(fn);
+		const std::vector<log_block> &blocks = db.get_blocks();
+		for(int b = 0; b < int(blocks.size()); b++)
+		{
+			swarmdb::Pbuffer hold;
+			add_records(expected, db.block_data(blocks[b], hold), blocks[b].len);
+		}
+	}
+	std::stable_sort(expected.begin(), expected.end());
+
+	// runs get at least 1 MB, the log must be split into several
+	size_t datalen = 0;
+	for(int k = 0; k < int(expected.size()); k++) { datalen += expected[k].data.size(); }
+	if(datalen < 2*1024*1024)
+	{
+		fprintf(stderr, "%s: %d bytes of records are sorted in one run\n", fn.c_str(), int(datalen));
+		return 1;
+	}
+
+	std::string sorted = fn + ".sorted";
+	if(!sort_binary_log_file(sorted, fn, max_memory))
+	{
+		fprintf(stderr, "%s: sort failed\n", fn.c_str());
+		return 1;
+	}
+
+	std::ifstream in(sorted.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	std::vector<keyed_record> recs;
+	if(data.size() >= sizeof(swarm_header))
+	{
+		add_records(recs, &data[0] + sizeof(swarm_header), data.size() - sizeof(swarm_header));
+	}
+	remove(sorted.c_str());
+
+	int failed = 0;
+	if(recs.size() != expected.size())
+	{
+		fprintf(stderr, "%s: %d sorted records instead of %d\n", fn.c_str(), int(recs.size()), int(expected.size()));
+		failed++;
+	}
+	for(int k = 0; !failed && k < int(recs.size()); k++)
+	{
+		if(recs[k].data != expected[k].data)
+		{
+			fprintf(stderr, "%s: sorted record %d differs\n", fn.c_str(), k);
+			failed++;
+		}
+	}
+
+	printf("%s: %d records sorted, %d differences\n", fn.c_str(), int(recs.size()), failed);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	std::string prefix = argc > 1 ? argv[1] : "sort";
+	int failed = 0;
+
+	// the smallest runs and merge chunks, for logs of a few MB
+	const int nsteps = 601, nsys = 30, stride = 97;
+	const size_t max_memory = 1;
+
+	config plain; plain["log_writer"] = "binary";
+	test::write_log(plain, prefix + ".plain", nsteps, nsys, 4, stride);
+	failed += check_sort(prefix + ".plain.raw", max_memory);
+
+	config framed; framed["log_writer"] = "binary"; framed["log_block_size"] = "16384";
+	test::write_log(framed, prefix + ".framed", nsteps, nsys, 4, stride);
+	failed += check_sort(prefix + ".framed.raw", max_memory);
+
+	config delta; delta["log_writer"] = "binary"; delta["log_snapshot_encoding"] = "delta"; delta["log_keyframe_interval"] = "16";
+	test::write_log(delta, prefix + ".delta", nsteps, nsys, 4, stride);
+	failed += check_sort(prefix + ".delta.raw", max_memory);
+
+	// block-compressed logs, whose blocks are decompressed by the sort
+	std::vector<std::string> codecs;
+#ifdef SWARM_HAVE_LZ4
+	codecs.push_back("lz4");
+#endif
+#ifdef SWARM_HAVE_ZSTD
+	codecs.push_back("zstd");
+#endif
+	if(!codecs.empty())
+	{
+		config compressed; compressed["log_writer"] = "compressed"; compressed["log_compression"] = codecs[0];
+		compressed["log_block_size"] = "16384";
+		test::write_log(compressed, prefix + "." + codecs[0], nsteps, nsys, 4, stride);
+		failed += check_sort(prefix + "." + codecs[0] + ".raw", max_memory);
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/*************************************************************************
+ * Copyright (C) 2012 by the Swarm-NG Development Team                   *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file format.cpp
+ *    \brief Tests format_e, format_g and format_d against snprintf.
+ *
+ *  The values cover rounding ties, powers of ten and their neighbours,
+ *  subnormals, infinities, NaN and random bit patterns.
+ *
+ *  Returns a nonzero exit status if a check fails.
+ */
+
+#include "swarm/common.hpp"
+#include "swarm/format.hpp"
+#include <climits>
+#include <cstring>
+
+using namespace swarm;
+
+//! Deterministic random 64-bit numbers, the same on every platform
+static unsigned long long random_bits()
+{
+	static unsigned long long s = 88172645463325252ULL;
+	s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+	return s;
+}
+
+static double uniform()
+{
+	return (random_bits() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static long checked = 0, failed = 0;
+
+static void report(const char *conv, int prec, int width, double v, const char *got, const char *expected)
+{
+	if(failed++ < 20)
+		fprintf(stderr, "%s prec=%d width=%d v=%.17g: '%s' instead of '%s'\n", conv, prec, width, v, got, expected);
+}
+
+//! Compare the output of every conversion of v with snprintf
+static void check(double v)
+{
+	static const int precisions[] = { 0, 1, 2, 5, 6, 9, 15, 16, 17 };
+	static const int widths[] = { 0, 9, 12 };
+	char got[64], expected[64];
+
+	for(int p = 0; p < int(sizeof(precisions)/sizeof(precisions[0])); p++)
+	{
+		const int prec = precisions[p];
+		for(int w = 0; w < int(sizeof(widths)/sizeof(widths[0])); w++)
+			for(int space = 0; space < 2; space++)
+			{
+				const int width = widths[w];
+				int n = format_g(got, v, prec, width, space);
+				int m = snprintf(expected, sizeof(expected), space ? "% *.*g" : "%*.*g", width, prec, v);
+				checked++;
+				if(n != m || strcmp(got, expected) != 0)
+					report(space ? "% g" : "%g", prec, width, v, got, expected);
+			}
+
+		if(prec <= 16)
+		{
+			int n = format_e(got, v, prec);
+			int m = snprintf(expected, sizeof(expected), "%.*e", prec, v);
+			checked++;
+			if(n != m || strcmp(got, expected) != 0)
+				report("%e", prec, 0, v, got, expected);
+		}
+	}
+}
+
+static void check_d(int v)
+{
+	static const int widths[] = { 0, 6, 10, 12 };
+	char got[64], expected[64];
+	for(int w = 0; w < int(sizeof(widths)/sizeof(widths[0])); w++)
+	{
+		int n = format_d(got, v, widths[w]);
+		int m = snprintf(expected, sizeof(expected), "%*d", widths[w], v);
+		checked++;
+		if(n != m || strcmp(got, expected) != 0)
+			report("%d", 0, widths[w], v, got, expected);
+	}
+}
+
+int main()
+{
+	const double zero = 0.;
+	const double specials[] = { 0., -0., 0.5, 1.5, 2.5, -3.25, 0.125, 0.375, 9.5, 95., 0.95,
+		1e-5, 9.9999e-5, 0.0001, 0.000123456789, 99999.5, 999999.5, 123456.5, 12345678.5,
+		1e15, 1e16, 1e17, 1e22, 1e23, 1e-300, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+		1./zero, -1./zero, zero/zero };
+	for(int k = 0; k < int(sizeof(specials)/sizeof(specials[0])); k++)
+		check(specials[k]);
+
+	for(int k = -330; k <= 310; k++)
+	{
+		double p = pow(10., k);
+		check(p); check(nextafter(p, 0.)); check(nextafter(p, HUGE_VAL)); check(-p);
+	}
+
+	for(int k = 0; k < 20000; k++)
+	{
+		// values of the magnitudes in the logs
+		check((2.*uniform() - 1.) * pow(10., int(random_bits() % 81) - 40));
+		// any double
+		unsigned long long bits = random_bits();
+		double v;
+		memcpy(&v, &bits, sizeof(v));
+		check(v);
+		// ties of the decimal rounding
+		check(double(random_bits() % 100000) / (1 << (random_bits() % 12)));
+		check(double(random_bits() % 1000) + 0.5);
+	}
+
+	check_d(0); check_d(1); check_d(-1); check_d(INT_MAX); check_d(INT_MIN);
+	for(int k = 0; k < 100000; k++)
+		check_d(int(random_bits()));
+
+	printf("%ld conversions, %ld differ from snprintf\n", checked, failed);
+	return failed == 0 ? 0 : 1;
+}